@@ -8,12 +8,81 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <sstream>
 #include <string>
 #include <functional>
 #include <cassert>
 #include <cstdint>
+#include <cstdlib>
 #include <type_traits>
 #include <atomic>
+#include <memory>
+#include <thread>
+#include <exception>
+#include <regex>
+#include <stdexcept>
+#include <fstream>
+#include <cstdio>
+#include <cctype>
+#include <iterator>
+#include <tuple>
+#include <cstring>
+#include <mutex>
+#include <deque>
+#include <future>
+#include <random>
+#include <typeinfo>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#define PERFLITE_HAS_TSC 1
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#elif defined(__aarch64__) && !defined(_MSC_VER)
+#define PERFLITE_HAS_CNTVCT 1
+#endif
+
+// C++20 coroutines: run_async() also accepts callables returning awaitables.
+#if defined(__cpp_impl_coroutine) && defined(__has_include)
+#if __has_include(<coroutine>)
+#include <coroutine>
+#define PERFLITE_HAS_COROUTINES 1
+#endif
+#endif
+
+// Vectorized statistics kernels: AVX2/AVX-512 via target attributes and
+// runtime dispatch (GCC/Clang), NEON on AArch64, scalar otherwise.
+#if defined(PERFLITE_HAS_TSC) && defined(__GNUC__) && !defined(_MSC_VER)
+#include <immintrin.h>
+#define PERFLITE_HAS_X86_KERNELS 1
+#elif defined(PERFLITE_HAS_CNTVCT) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define PERFLITE_HAS_NEON_KERNELS 1
+#endif
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <cerrno>
+#define PERFLITE_HAS_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define PERFLITE_HAS_MMAP 1
+#elif defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
 
 namespace PerfLite {
 
@@ -63,235 +132,6181 @@ inline void DoNotOptimize(T& value) {
 #endif
 }
 
-// Structure to hold benchmark results and compute statistics.
-struct BenchmarkResult {
-    std::string name;
-    std::vector<std::chrono::duration<double, std::nano>> durations;
-    double min_time;
-    double mean_time;
-    double stddev_time;
-    double ops_per_sec;
-    TimeUnit time_unit;
+// Clock backend used for timing the measured loop.
+enum class ClockSource {
+    Chrono,       // std::chrono::high_resolution_clock
+    CycleCounter  // rdtsc/rdtscp on x86, cntvct_el0 on AArch64 (falls back to Chrono elsewhere)
+};
 
-    // Constructor initializes all fields to safe defaults.
-    explicit BenchmarkResult(TimeUnit unit = TimeUnit::Nanoseconds)
-        : min_time(0.0), mean_time(0.0), stddev_time(0.0), ops_per_sec(0.0), time_unit(unit) {}
+// Clock policy over std::chrono::high_resolution_clock. Ticks are nanoseconds.
+struct ChronoClock {
+    static constexpr bool counts_cycles = false;
 
-    // Calculates statistics from collected durations.
-    // Converts results to the specified time unit.
-    void calculate_statistics() {
-        if (durations.empty()) {
-            std::cerr << "Warning: No durations recorded for benchmark '" << name << "'\n";
+    static uint64_t start() { return now(); }
+    static uint64_t stop() { return now(); }
+    static double ns_per_tick() { return 1.0; }
+
+private:
+    static uint64_t now() {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::high_resolution_clock::now().time_since_epoch()).count());
+    }
+};
+
+// Clock policy over the CPU cycle counter. Reads are serialized so that the
+// measured code cannot be reordered across them: lfence/rdtsc/lfence to start
+// and rdtscp/lfence to stop on x86, isb + cntvct_el0 on AArch64. Ticks are
+// converted to nanoseconds with a ratio calibrated once per process.
+//
+// Note: the x86 TSC counts reference cycles at a constant rate, not core
+// cycles, so cycle counts do not follow turbo or frequency scaling.
+struct CycleClock {
+#if defined(PERFLITE_HAS_TSC) || defined(PERFLITE_HAS_CNTVCT)
+    static constexpr bool counts_cycles = true;
+
+    static uint64_t start() {
+#if defined(PERFLITE_HAS_TSC)
+        _mm_lfence();
+        uint64_t t = __rdtsc();
+        _mm_lfence();
+        return t;
+#else
+        uint64_t t;
+        asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(t) : : "memory");
+        return t;
+#endif
+    }
+
+    static uint64_t stop() {
+#if defined(PERFLITE_HAS_TSC)
+        unsigned int aux;
+        uint64_t t = __rdtscp(&aux);
+        _mm_lfence();
+        return t;
+#else
+        uint64_t t;
+        asm volatile("isb\n\tmrs %0, cntvct_el0" : "=r"(t) : : "memory");
+        return t;
+#endif
+    }
+
+    // Nanoseconds per tick, calibrated on first use.
+    static double ns_per_tick() {
+        static const double ratio = calibrate();
+        return ratio;
+    }
+
+private:
+    static double calibrate() {
+#if defined(PERFLITE_HAS_CNTVCT)
+        // The generic timer reports its own frequency.
+        uint64_t freq;
+        asm volatile("mrs %0, cntfrq_el0" : "=r"(freq));
+        if (freq > 0) {
+            return 1e9 / static_cast<double>(freq);
+        }
+#endif
+        // Compare the counter against the steady clock over a short busy-wait.
+        using steady = std::chrono::steady_clock;
+        const auto wall_start = steady::now();
+        const uint64_t ticks_start = start();
+        while (steady::now() - wall_start < std::chrono::milliseconds(10)) {
+        }
+        const uint64_t ticks_end = stop();
+        const auto wall_end = steady::now();
+        const double wall_ns = std::chrono::duration<double, std::nano>(wall_end - wall_start).count();
+        const double ticks = static_cast<double>(ticks_end - ticks_start);
+        return (ticks > 0.0) ? wall_ns / ticks : 1.0;
+    }
+#else
+    // No cycle counter on this architecture: behave like ChronoClock.
+    static constexpr bool counts_cycles = false;
+
+    static uint64_t start() { return ChronoClock::start(); }
+    static uint64_t stop() { return ChronoClock::stop(); }
+    static double ns_per_tick() { return 1.0; }
+#endif
+};
+
+// Process-wide heap allocation counters fed by PerfLite's replacement
+// operator new/delete. The replacement is compiled only into the one
+// translation unit that defines PERFLITE_TRACK_ALLOCATIONS before including
+// this header; without it, `installed` stays false and nothing is counted.
+struct AllocationCounters {
+    static inline std::atomic<bool> installed{false};
+    static inline std::atomic<bool> enabled{false};
+    static inline std::atomic<uint64_t> allocations{0};
+    static inline std::atomic<uint64_t> bytes{0};
+    static inline std::atomic<int64_t> live_bytes{0};
+    static inline std::atomic<int64_t> peak_live_bytes{0};
+
+    // Clears the counts; live bytes are measured relative to this point.
+    static void reset() {
+        allocations.store(0, std::memory_order_relaxed);
+        bytes.store(0, std::memory_order_relaxed);
+        live_bytes.store(0, std::memory_order_relaxed);
+        peak_live_bytes.store(0, std::memory_order_relaxed);
+    }
+
+    static void on_allocate(size_t size) {
+        if (!enabled.load(std::memory_order_relaxed)) {
             return;
         }
+        allocations.fetch_add(1, std::memory_order_relaxed);
+        bytes.fetch_add(size, std::memory_order_relaxed);
+        const int64_t live = live_bytes.fetch_add(static_cast<int64_t>(size), std::memory_order_relaxed)
+                           + static_cast<int64_t>(size);
+        int64_t peak = peak_live_bytes.load(std::memory_order_relaxed);
+        while (live > peak && !peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+        }
+    }
 
-        size_t n = durations.size();
-    
-        // 1. Convert EVERYTHING to a high-precision double (Nanoseconds) first
-        // This prevents 0.0002ms from becoming 0.
-        std::vector<double> values_ns;
-        for(const auto& d : durations) {
-            values_ns.push_back(d.count());
+    static void on_deallocate(size_t size) {
+        if (enabled.load(std::memory_order_relaxed)) {
+            live_bytes.fetch_sub(static_cast<int64_t>(size), std::memory_order_relaxed);
         }
+    }
+};
 
-        // 2. Determine the conversion factor to the target unit
-        double divisor = 1.0;
-        if (time_unit == TimeUnit::Milliseconds) divisor = 1e6;
-        else if (time_unit == TimeUnit::Microseconds) divisor = 1e3;
-        else if (time_unit == TimeUnit::Nanoseconds) divisor = 1.0;
-        else divisor = 1e9; // Seconds
+// Per-iteration value of one hardware performance counter.
+struct CounterValue {
+    std::string name;
+    double per_iteration;
+};
 
-        // 3. Calculate Stats using the double values
-        double sum_ns = std::accumulate(values_ns.begin(), values_ns.end(), 0.0);
-        double mean_ns = sum_ns / n;
-        
-        // Convert results to target unit
-        mean_time = mean_ns / divisor;
-        
-        auto min_it = std::min_element(values_ns.begin(), values_ns.end());
-        min_time = (*min_it) / divisor;
+// Hardware performance counters read through Linux perf_event_open.
+// Events are opened as two groups (core: cycles, instructions, branch-misses;
+// memory: cache-misses, LLC loads, dTLB load misses) so that related counts
+// are scheduled together; each group is enabled and read once around the
+// measured loop, never per iteration. Counts are scaled by
+// time_enabled/time_running when the kernel multiplexes groups. Events the
+// PMU or the permissions do not allow are skipped; on other platforms no
+// counters are available.
+class PerfCounters {
+public:
+    PerfCounters() {
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+        const uint64_t llc_loads = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                   (PERF_COUNT_HW_CACHE_RESULT_ACCESS << 16);
+        const uint64_t dtlb_misses = PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                     (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        open_group({{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+                    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+                    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES}});
+        open_group({{"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+                    {"llc-loads", PERF_TYPE_HW_CACHE, llc_loads},
+                    {"dtlb-misses", PERF_TYPE_HW_CACHE, dtlb_misses}});
+#endif
+    }
 
-        // 4. Variance with double precision
-        double variance_ns = 0.0;
-        for (double v : values_ns) {
-            variance_ns += (v - mean_ns) * (v - mean_ns);
+    ~PerfCounters() {
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+        for (const auto& group : groups_) {
+            for (const auto& event : group.events) {
+                close(event.fd);
+            }
         }
-        variance_ns /= (n > 1) ? (n - 1) : 1;
-        
-        // Convert StdDev to target unit
-        stddev_time = std::sqrt(variance_ns) / divisor;
+#endif
+    }
 
-        // 5. Ops per second (Always use NS for this)
-        ops_per_sec = (mean_ns > 0) ? (1e9 / mean_ns) : 0.0;
+    PerfCounters(const PerfCounters&) = delete;
+    PerfCounters& operator=(const PerfCounters&) = delete;
+
+    // True if at least one counter could be opened.
+    bool available() const { return !groups_.empty(); }
+
+    // Resets and enables all groups.
+    void start() {
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+        for (const auto& group : groups_) {
+            ioctl(group.events.front().fd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+            ioctl(group.events.front().fd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
     }
 
-    // Prints results to the specified output stream with unit-appropriate precision.
-    void print(std::ostream& os = std::cout) const {
-        // Adjust precision based on time unit
-        int precision = (time_unit == TimeUnit::Nanoseconds) ? 2 : 
-                        (time_unit == TimeUnit::Microseconds) ? 3 :
-                        (time_unit == TimeUnit::Milliseconds) ? 4 : 6;
-        os << std::fixed << std::setprecision(precision);
-        os << "Benchmark: " << name << "\n";
-        os << "  Min:      " << min_time << " " << time_unit_to_string() << "\n";
-        os << "  Mean:     " << mean_time << " " << time_unit_to_string() << "\n";
-        os << "  StdDev:   " << stddev_time << " " << time_unit_to_string() << "\n";
-        os << "  Ops/sec:  " << ops_per_sec << "\n\n";
+    // Disables all groups.
+    void stop() {
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+        for (const auto& group : groups_) {
+            ioctl(group.events.front().fd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+        }
+#endif
     }
 
-private:
-    // Helper to convert TimeUnit to string for output
-    std::string time_unit_to_string() const {
-        switch (time_unit) {
-            case TimeUnit::Nanoseconds: return "ns";
-            case TimeUnit::Microseconds: return "µs";
-            case TimeUnit::Milliseconds: return "ms";
-            case TimeUnit::Seconds: return "s";
-            default: return "unknown";
+    // Reads every group once and returns the counts divided by `iterations`.
+    std::vector<CounterValue> read(uint64_t iterations) const {
+        std::vector<CounterValue> values;
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+        for (const auto& group : groups_) {
+            // Layout for PERF_FORMAT_GROUP | TOTAL_TIME_ENABLED | TOTAL_TIME_RUNNING:
+            // nr, time_enabled, time_running, value[nr]
+            std::vector<uint64_t> buffer(3 + group.events.size(), 0);
+            const ssize_t expected = static_cast<ssize_t>(buffer.size() * sizeof(uint64_t));
+            if (::read(group.events.front().fd, buffer.data(), expected) != expected) {
+                continue;
+            }
+            const double enabled = static_cast<double>(buffer[1]);
+            const double running = static_cast<double>(buffer[2]);
+            const double scale = (running > 0.0) ? enabled / running : 0.0;
+            for (size_t i = 0; i < group.events.size() && i < buffer[0]; ++i) {
+                const double count = static_cast<double>(buffer[3 + i]) * scale;
+                values.push_back(CounterValue{group.events[i].name,
+                                              count / static_cast<double>(std::max<uint64_t>(iterations, 1))});
+            }
         }
+#else
+        (void)iterations;
+#endif
+        return values;
     }
-};
 
-// Benchmark runner class for configuring and executing benchmarks.
-class Benchmark {
 private:
-    size_t warmup_iterations_;
-    size_t iterations_;
-    std::chrono::milliseconds target_duration_;
-    TimeUnit time_unit_;
-    std::string name_;
+#if defined(PERFLITE_HAS_PERF_EVENTS)
+    struct EventSpec {
+        const char* name;
+        uint32_t type;
+        uint64_t config;
+    };
 
-public:
-    // Constructor with default configuration.
-    Benchmark()
-        : warmup_iterations_(10),
-          iterations_(1000),
-          target_duration_(100),
-          time_unit_(TimeUnit::Nanoseconds),
-          name_("Benchmark") {}
+    struct OpenEvent {
+        std::string name;
+        int fd;
+    };
 
-    // Sets the number of warmup iterations (must be non-zero).
-    Benchmark& warmup(size_t count) {
-        assert(count > 0 && "Warmup iterations must be greater than zero");
-        warmup_iterations_ = count;
-        return *this;
+    struct Group {
+        std::vector<OpenEvent> events;  // events.front() is the group leader
+    };
+
+    static int open_event(const EventSpec& spec, int group_fd) {
+        perf_event_attr attr{};
+        attr.size = sizeof(attr);
+        attr.type = spec.type;
+        attr.config = spec.config;
+        attr.disabled = (group_fd == -1) ? 1 : 0;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
     }
 
-    // Sets the number of benchmark iterations (must be non-zero).
-    Benchmark& iterations(size_t count) {
-        assert(count > 0 && "Benchmark iterations must be greater than zero");
-        iterations_ = count;
-        return *this;
+    void open_group(std::initializer_list<EventSpec> specs) {
+        Group group;
+        for (const auto& spec : specs) {
+            const int leader = group.events.empty() ? -1 : group.events.front().fd;
+            const int fd = open_event(spec, leader);
+            if (fd >= 0) {
+                group.events.push_back(OpenEvent{spec.name, fd});
+            }
+        }
+        if (!group.events.empty()) {
+            groups_.push_back(std::move(group));
+        }
     }
+#else
+    struct Group {};
+#endif
+    std::vector<Group> groups_;
+};
 
-    // Sets the target total duration for benchmarking.
-    Benchmark& target_duration(std::chrono::milliseconds duration) {
-        assert(duration.count() > 0 && "Target duration must be greater than zero");
-        target_duration_ = duration;
-        return *this;
+namespace detail {
+
+// CPUs the calling thread may run on, in ascending order. Empty when the
+// platform does not expose affinity masks.
+inline std::vector<int> allowed_cpus() {
+    std::vector<int> cpus;
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                cpus.push_back(cpu);
+            }
+        }
+    }
+#elif defined(_WIN32)
+    DWORD_PTR process_mask = 0, system_mask = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process_mask, &system_mask)) {
+        for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); ++cpu) {
+            if (process_mask & (DWORD_PTR(1) << cpu)) {
+                cpus.push_back(cpu);
+            }
+        }
     }
+#endif
+    return cpus;
+}
 
-    // Sets the time unit for output.
-    Benchmark& unit(TimeUnit unit) {
-        time_unit_ = unit;
-        return *this;
+// Pins the calling thread to one CPU. Returns false if unsupported or denied.
+inline bool pin_current_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+// Pins the calling thread for the lifetime of the guard and restores the
+// previous affinity afterwards. A negative CPU leaves the thread alone.
+class ScopedAffinity {
+public:
+    explicit ScopedAffinity(int cpu) {
+        if (cpu < 0) {
+            return;
+        }
+#if defined(__linux__)
+        CPU_ZERO(&previous_);
+        saved_ = pthread_getaffinity_np(pthread_self(), sizeof(previous_), &previous_) == 0;
+        pinned_ = pin_current_thread(cpu);
+#elif defined(_WIN32)
+        previous_ = SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu);
+        pinned_ = saved_ = previous_ != 0;
+#endif
     }
 
-    // Sets the benchmark name.
-    Benchmark& name(const std::string& n) {
-        name_ = n;
-        return *this;
+    ~ScopedAffinity() {
+        if (!pinned_ || !saved_) {
+            return;
+        }
+#if defined(__linux__)
+        pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+#elif defined(_WIN32)
+        SetThreadAffinityMask(GetCurrentThread(), previous_);
+#endif
     }
 
-    // Runs the benchmark with the specified function.
-    // Adjusts iterations to meet the target duration (minimum 100ms by default).
-    // Handles both void and non-void return types.
-    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func>>>
-    BenchmarkResult run(Func&& func) const {
-        BenchmarkResult result(time_unit_);
-        result.name = name_;
-        result.durations.reserve(iterations_);
+    ScopedAffinity(const ScopedAffinity&) = delete;
+    ScopedAffinity& operator=(const ScopedAffinity&) = delete;
 
-        // Warmup phase to stabilize performance
-        for (size_t i = 0; i < warmup_iterations_; ++i) {
-            func();
-        }
+    bool pinned() const { return pinned_; }
 
-        // Measure execution time for 1000 iterations to estimate per-iteration time
-        auto measure_start = std::chrono::high_resolution_clock::now();
-        for (size_t i = 0; i < 1000; ++i) {
-            if constexpr (std::is_same_v<std::invoke_result_t<Func>, void>) {
-                func();
-                std::atomic_thread_fence(std::memory_order_seq_cst); // Memory barrier for void functions
-            } else {
-                auto func_result_measure = func();
-                DoNotOptimize(func_result_measure);
+private:
+    bool pinned_ = false;
+    bool saved_ = false;
+#if defined(__linux__)
+    cpu_set_t previous_;
+#elif defined(_WIN32)
+    DWORD_PTR previous_ = 0;
+#endif
+};
+
+// Raises the calling thread's scheduling priority for the lifetime of the
+// guard: SCHED_FIFO if permitted, otherwise a lower nice value on Linux, and
+// THREAD_PRIORITY_HIGHEST on Windows. Restores the previous setting.
+class ScopedPriority {
+public:
+    explicit ScopedPriority(bool enable) {
+        if (!enable) {
+            return;
+        }
+#if defined(__linux__)
+        if (pthread_getschedparam(pthread_self(), &policy_, &param_) == 0) {
+            sched_param fifo{};
+            fifo.sched_priority = sched_get_priority_min(SCHED_FIFO);
+            if (pthread_setschedparam(pthread_self(), SCHED_FIFO, &fifo) == 0) {
+                mode_ = Mode::Realtime;
+                return;
             }
         }
-        auto measure_end = std::chrono::high_resolution_clock::now();
-        auto total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(measure_end - measure_start);
+        tid_ = static_cast<id_t>(syscall(SYS_gettid));
+        errno = 0;
+        nice_ = getpriority(PRIO_PROCESS, tid_);
+        if (errno == 0 && setpriority(PRIO_PROCESS, tid_, -10) == 0) {
+            mode_ = Mode::Nice;
+        }
+#elif defined(_WIN32)
+        previous_ = GetThreadPriority(GetCurrentThread());
+        if (SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_HIGHEST)) {
+            mode_ = Mode::Realtime;
+        }
+#endif
+    }
 
-        uint64_t adjusted_iterations = iterations_;
+    ~ScopedPriority() {
+#if defined(__linux__)
+        if (mode_ == Mode::Realtime) {
+            pthread_setschedparam(pthread_self(), policy_, &param_);
+        } else if (mode_ == Mode::Nice) {
+            setpriority(PRIO_PROCESS, tid_, nice_);
+        }
+#elif defined(_WIN32)
+        if (mode_ == Mode::Realtime) {
+            SetThreadPriority(GetCurrentThread(), previous_);
+        }
+#endif
+    }
 
-        if (total_time.count() > 0) {
-            // 1. Calculate Target Duration in nanoseconds (1 ms = 1,000,000 ns)
-            const uint64_t target_duration_ns = target_duration_.count() * 1'000'000LL;
+    ScopedPriority(const ScopedPriority&) = delete;
+    ScopedPriority& operator=(const ScopedPriority&) = delete;
 
-            // 2. Calculate Time Per Iteration in nanoseconds
-            // total_time is the time for 1000 runs.
-            const double time_per_iteration_ns = static_cast<double>(total_time.count()) / 1000.0;
+    bool raised() const { return mode_ != Mode::None; }
 
-            // 3. Calculate Adjusted Iterations: Target_ns / Time_Per_Iteration_ns
-            if (time_per_iteration_ns > 0.0) {
-                adjusted_iterations = static_cast<uint64_t>(
-                    static_cast<double>(target_duration_ns) / time_per_iteration_ns
-                );
-            }
-            
-            // Ensure minimum 1000 iterations and cap at 1,000,000 to prevent overflow/excessive runtime
-            adjusted_iterations = std::max(adjusted_iterations, static_cast<uint64_t>(1000));
-            adjusted_iterations = std::min(adjusted_iterations, static_cast<uint64_t>(1'000'000));
+private:
+    enum class Mode { None, Realtime, Nice };
+    Mode mode_ = Mode::None;
+#if defined(__linux__)
+    int policy_ = 0;
+    sched_param param_{};
+    id_t tid_ = 0;
+    int nice_ = 0;
+#elif defined(_WIN32)
+    int previous_ = 0;
+#endif
+};
+
+// Enables the allocation counters for the lifetime of the guard (if asked
+// to) and disables them again on stop() or destruction.
+class AllocationScope {
+public:
+    explicit AllocationScope(bool enable) : active_(enable) {
+        if (active_) {
+            AllocationCounters::reset();
+            AllocationCounters::enabled.store(true, std::memory_order_relaxed);
         }
+    }
+    ~AllocationScope() { stop(); }
 
-        // Run actual benchmark
-        for (size_t i = 0; i < adjusted_iterations; ++i) {
-            auto iter_start = std::chrono::high_resolution_clock::now();
-            if constexpr (std::is_same_v<std::invoke_result_t<Func>, void>) {
-                func();
-                std::atomic_thread_fence(std::memory_order_seq_cst); // Memory barrier for void functions
-            } else {
-                auto func_result_iter = func();
-                DoNotOptimize(func_result_iter);
-            }
-            auto iter_end = std::chrono::high_resolution_clock::now();
-            result.durations.push_back(std::chrono::duration<double, std::nano>(iter_end - iter_start));
+    AllocationScope(const AllocationScope&) = delete;
+    AllocationScope& operator=(const AllocationScope&) = delete;
+
+    void stop() {
+        if (active_) {
+            AllocationCounters::enabled.store(false, std::memory_order_relaxed);
+            active_ = false;
         }
+    }
 
-        result.calculate_statistics();
-        return result;
+private:
+    bool active_;
+};
+
+// Process resource counters read around a measured loop: page faults and
+// context switches from getrusage(RUSAGE_SELF), the resident set from
+// /proc/self/statm and its high-water mark (VmHWM) from /proc/self/status.
+// All zero where unsupported.
+struct ResourceUsage {
+    uint64_t minor_faults = 0;
+    uint64_t major_faults = 0;
+    uint64_t voluntary_switches = 0;
+    uint64_t involuntary_switches = 0;
+    uint64_t rss_bytes = 0;
+    uint64_t peak_rss_bytes = 0;
+
+    static bool supported() {
+#if defined(__linux__)
+        return true;
+#else
+        return false;
+#endif
     }
 
-    // Runs the benchmark with a function and arguments.
-    template<typename Func, typename... Args>
-    BenchmarkResult run(Func&& func, Args&&... args) const {
-        auto wrapper = [&func, args...]() {
-            return func(args...);
-        };
-        return run(wrapper);
+    static ResourceUsage capture() {
+        ResourceUsage usage;
+#if defined(__linux__)
+        rusage ru{};
+        if (getrusage(RUSAGE_SELF, &ru) == 0) {
+            usage.minor_faults = static_cast<uint64_t>(ru.ru_minflt);
+            usage.major_faults = static_cast<uint64_t>(ru.ru_majflt);
+            usage.voluntary_switches = static_cast<uint64_t>(ru.ru_nvcsw);
+            usage.involuntary_switches = static_cast<uint64_t>(ru.ru_nivcsw);
+        }
+        const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        std::ifstream statm("/proc/self/statm");
+        uint64_t size_pages = 0;
+        uint64_t resident_pages = 0;
+        if (statm >> size_pages >> resident_pages) {
+            usage.rss_bytes = resident_pages * page;
+        }
+        std::ifstream status("/proc/self/status");
+        std::string line;
+        while (std::getline(status, line)) {
+            if (line.compare(0, 6, "VmHWM:") == 0) {
+                usage.peak_rss_bytes = std::strtoull(line.c_str() + 6, nullptr, 10) * 1024;
+                break;
+            }
+        }
+#endif
+        return usage;
     }
 };
 
-// Convenience function for running a benchmark with default configuration.
-template<typename Func>
-BenchmarkResult benchmark(Func&& func) {
-    return Benchmark().run(func);
-}
+// Takes a ResourceUsage snapshot at construction and another at stop().
+// Starting resets the kernel's peak-RSS mark (clear_refs, Linux 4.0+) so
+// that the peak belongs to the measured loop; this also lowers the
+// process's later ru_maxrss.
+class MemoryScope {
+public:
+    explicit MemoryScope(bool enable) : active_(enable && ResourceUsage::supported()) {
+#if defined(__linux__)
+        if (active_) {
+            std::ofstream clear_refs("/proc/self/clear_refs");
+            peak_reset_ = static_cast<bool>(clear_refs << "5") && static_cast<bool>(clear_refs.flush());
+            start_ = ResourceUsage::capture();
+        }
+#endif
+    }
 
-template<typename Func, typename... Args>
-BenchmarkResult benchmark(Func&& func, Args&&... args) {
-    return Benchmark().run(func, args...);
-}
+    MemoryScope(const MemoryScope&) = delete;
+    MemoryScope& operator=(const MemoryScope&) = delete;
 
-} // namespace PerfLite
+    void stop() {
+        if (active_ && !stopped_) {
+            end_ = ResourceUsage::capture();
+            stopped_ = true;
+        }
+    }
+
+    bool measured() const { return active_ && stopped_; }
+    const ResourceUsage& start() const { return start_; }
+    const ResourceUsage& end() const { return end_; }
+
+    // Highest resident set seen during the scope, above its starting level.
+    uint64_t peak_rss_growth() const {
+        uint64_t peak = end_.rss_bytes;
+        if (peak_reset_ || end_.peak_rss_bytes > start_.peak_rss_bytes) {
+            peak = std::max(peak, end_.peak_rss_bytes);
+        }
+        return (peak > start_.rss_bytes) ? peak - start_.rss_bytes : 0;
+    }
+
+private:
+    bool active_;
+    bool stopped_ = false;
+    bool peak_reset_ = false;
+    ResourceUsage start_;
+    ResourceUsage end_;
+};
+
+// First line of a text file, or an empty string if it cannot be read.
+inline std::string read_first_line(const std::string& path) {
+#if defined(__linux__)
+    std::ifstream in(path);
+    std::string line;
+    std::getline(in, line);
+    return line;
+#else
+    (void)path;
+    return std::string();
+#endif
+}
+
+// Parses a sysfs CPU list such as "0-3,8,10-11".
+inline std::vector<int> parse_cpu_list(const std::string& text) {
+    std::vector<int> cpus;
+    const char* p = text.c_str();
+    while (*p) {
+        char* end = nullptr;
+        const long first = std::strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = std::strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            cpus.push_back(static_cast<int>(cpu));
+        }
+        if (*p == ',') {
+            ++p;
+        }
+    }
+    return cpus;
+}
+
+// One allowed CPU per physical core (its lowest-numbered SMT sibling), so
+// that workers placed on them never share a core. The kernel's isolated
+// CPUs (isolcpus=) are used when any of them are allowed. Without topology
+// information every allowed CPU counts as its own core.
+inline std::vector<int> physical_core_cpus() {
+    std::vector<int> allowed = allowed_cpus();
+    const std::vector<int> isolated = parse_cpu_list(read_first_line("/sys/devices/system/cpu/isolated"));
+    std::vector<int> candidates;
+    std::copy_if(allowed.begin(), allowed.end(), std::back_inserter(candidates), [&isolated](int cpu) {
+        return std::find(isolated.begin(), isolated.end(), cpu) != isolated.end();
+    });
+    if (candidates.empty()) {
+        candidates = allowed;
+    }
+    std::vector<int> cores;
+    std::vector<int> covered;
+    for (const int cpu : candidates) {
+        if (std::find(covered.begin(), covered.end(), cpu) != covered.end()) {
+            continue;
+        }
+        cores.push_back(cpu);
+        const std::vector<int> siblings = parse_cpu_list(read_first_line(
+            "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/topology/thread_siblings_list"));
+        covered.insert(covered.end(), siblings.begin(), siblings.end());
+    }
+    return cores;
+}
+
+// Size in bytes of the largest data or unified cache of CPU 0, or 32 MB if
+// the system does not report it.
+inline size_t last_level_cache_size() {
+    static const size_t size = [] {
+        size_t largest = 0;
+#if defined(__linux__)
+        for (int i = 0; i < 16; ++i) {
+            const std::string base = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i) + "/";
+            const std::string type = read_first_line(base + "type");
+            if (type.empty()) {
+                break;
+            }
+            if (type == "Instruction") {
+                continue;
+            }
+            const std::string text = read_first_line(base + "size");  // e.g. "32768K"
+            char* end = nullptr;
+            unsigned long long bytes = std::strtoull(text.c_str(), &end, 10);
+            if (end && *end == 'K') {
+                bytes <<= 10;
+            } else if (end && *end == 'M') {
+                bytes <<= 20;
+            }
+            largest = std::max(largest, static_cast<size_t>(bytes));
+        }
+#endif
+        return largest > 0 ? largest : size_t{32} << 20;
+    }();
+    return size;
+}
+
+// Evicts data from the caches between cold-cache samples: flushes every
+// line of a user buffer (clflush on x86, dc civac on AArch64), or, without
+// a buffer or a flush instruction, reads through a process-wide arena of
+// twice the last-level cache size (at most kMaxArenaBytes).
+class CacheEvictor {
+public:
+    static constexpr size_t kLine = 64;
+    static constexpr size_t kMaxArenaBytes = size_t{256} << 20;
+
+    CacheEvictor(const void* data, size_t bytes) : data_(static_cast<const char*>(data)), bytes_(bytes) {
+#if !defined(PERFLITE_HAS_TSC) && !defined(PERFLITE_HAS_CNTVCT)
+        data_ = nullptr;
+#endif
+        if (!data_ || bytes_ == 0) {
+            data_ = nullptr;
+            bytes_ = arena().size() * sizeof(uint64_t);
+        }
+    }
+
+    // True if a user buffer is flushed rather than an arena streamed.
+    bool flushes() const { return data_ != nullptr; }
+    size_t bytes() const { return bytes_; }
+
+    void evict() const {
+        if (data_) {
+            flush();
+            return;
+        }
+        const std::vector<uint64_t>& words = arena();
+        uint64_t sum = 0;
+        for (size_t i = 0; i < words.size(); i += kLine / sizeof(uint64_t)) {
+            sum += words[i];
+        }
+        DoNotOptimize(sum);
+    }
+
+private:
+    void flush() const {
+#if defined(PERFLITE_HAS_TSC)
+        for (size_t offset = 0; offset < bytes_; offset += kLine) {
+            _mm_clflush(data_ + offset);
+        }
+        _mm_mfence();
+#elif defined(PERFLITE_HAS_CNTVCT)
+        for (size_t offset = 0; offset < bytes_; offset += kLine) {
+            asm volatile("dc civac, %0" : : "r"(data_ + offset) : "memory");
+        }
+        asm volatile("dsb ish" : : : "memory");
+#endif
+    }
+
+    // Allocated and touched once per process.
+    static const std::vector<uint64_t>& arena() {
+        static const std::vector<uint64_t> words(
+            std::min(2 * last_level_cache_size(), kMaxArenaBytes) / sizeof(uint64_t), 1);
+        return words;
+    }
+
+    const char* data_;
+    size_t bytes_;
+};
+
+// Pre-faulted storage for raw samples (nanoseconds per call). Capacity is
+// reserved from the run plan before the timed loop and every page is
+// touched up front, so recording a sample is a plain store: no vector
+// growth and no first-touch page fault. Memory comes straight from the OS
+// and is not seen by the allocation counters.
+class SampleArena {
+public:
+    static constexpr size_t kPageBytes = 4096;
+    static constexpr size_t kHugePageBytes = size_t{2} << 20;
+
+    SampleArena() = default;
+    SampleArena(const SampleArena&) = delete;
+    SampleArena& operator=(const SampleArena&) = delete;
+    ~SampleArena() { release(data_, capacity_); }
+
+    // The calling thread's arena; it keeps its mapping between runs, so a
+    // suite only pays for the largest benchmark once.
+    static SampleArena& for_this_thread() {
+        thread_local SampleArena arena;
+        return arena;
+    }
+
+    // Ensures room for `count` samples in total, keeping those recorded so
+    // far. `huge_pages` asks for transparent huge pages for a new mapping
+    // (Linux only; ignored elsewhere).
+    void reserve(size_t count, bool huge_pages = false) {
+        if (count <= capacity_ && (huge_pages_ || !huge_pages)) {
+            return;
+        }
+        const size_t granule = huge_pages ? kHugePageBytes : kPageBytes;
+        const size_t bytes = (std::max(count, capacity_) * sizeof(double) + granule - 1) / granule * granule;
+        double* data = acquire(bytes, huge_pages);
+        std::copy(data_, data_ + size_, data);
+        release(data_, capacity_);
+        data_ = data;
+        capacity_ = bytes / sizeof(double);
+        huge_pages_ = huge_pages;
+    }
+
+    void clear() { size_ = 0; }
+
+    void push(double ns) {
+        assert(size_ < capacity_ && "SampleArena::reserve() must cover every sample");
+        data_[size_++] = ns;
+    }
+
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool huge_pages() const { return huge_pages_; }
+    const double* begin() const { return data_; }
+    const double* end() const { return data_ + size_; }
+    double operator[](size_t i) const { return data_[i]; }
+
+    // Appends the recorded samples to a result's durations.
+    void append_to(std::vector<std::chrono::duration<double, std::nano>>& out) const {
+        out.reserve(out.size() + size_);
+        for (size_t i = 0; i < size_; ++i) {
+            out.emplace_back(data_[i]);
+        }
+    }
+
+private:
+    static double* acquire(size_t bytes, bool huge_pages) {
+#if defined(PERFLITE_HAS_MMAP)
+        void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+#if defined(MADV_HUGEPAGE)
+        if (huge_pages) {
+            madvise(memory, bytes, MADV_HUGEPAGE);
+        }
+#endif
+#elif defined(_WIN32)
+        (void)huge_pages;
+        void* memory = VirtualAlloc(nullptr, bytes, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+#else
+        (void)huge_pages;
+        void* memory = std::malloc(bytes);
+        if (!memory) {
+            throw std::bad_alloc();
+        }
+#endif
+        // Fault every page in now rather than in the timed loop
+        volatile char* page = static_cast<char*>(memory);
+        for (size_t offset = 0; offset < bytes; offset += kPageBytes) {
+            page[offset] = 0;
+        }
+        return static_cast<double*>(memory);
+    }
+
+    static void release(double* data, size_t capacity) {
+        if (!data) {
+            return;
+        }
+#if defined(PERFLITE_HAS_MMAP)
+        munmap(data, capacity * sizeof(double));
+#elif defined(_WIN32)
+        (void)capacity;
+        VirtualFree(data, 0, MEM_RELEASE);
+#else
+        (void)capacity;
+        std::free(data);
+#endif
+    }
+
+    double* data_ = nullptr;
+    size_t size_ = 0;
+    size_t capacity_ = 0;
+    bool huge_pages_ = false;
+};
+
+// Instruction sets the statistics kernels below are built for (x86 levels
+// are picked at runtime, NEON is part of the AArch64 baseline).
+enum class SimdLevel {
+    Scalar,
+    Neon,
+    Avx2,
+    Avx512
+};
+
+inline SimdLevel simd_level() {
+    static const SimdLevel level = [] {
+#if defined(PERFLITE_HAS_X86_KERNELS)
+        if (__builtin_cpu_supports("avx512f")) {
+            return SimdLevel::Avx512;
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            return SimdLevel::Avx2;
+        }
+#elif defined(PERFLITE_HAS_NEON_KERNELS)
+        return SimdLevel::Neon;
+#endif
+        return SimdLevel::Scalar;
+    }();
+    return level;
+}
+
+// Sum, compensated sum of squares and range of a sample buffer, all from
+// a single pass. Samples are accumulated relative to the first one, which
+// keeps the one-pass variance as accurate as the two-pass formula for
+// timing data (spread small against the magnitude).
+struct SampleMoments {
+    size_t count = 0;
+    double shift = 0.0;
+    double sum = 0.0;     // Sum of (x - shift)
+    double sum_sq = 0.0;  // Sum of (x - shift)^2
+    double min = 0.0;
+    double max = 0.0;
+
+    double mean() const {
+        return (count > 0) ? shift + sum / static_cast<double>(count) : 0.0;
+    }
+
+    // Sample variance (n - 1 denominator).
+    double variance() const {
+        if (count < 2) {
+            return 0.0;
+        }
+        const double n = static_cast<double>(count);
+        return std::max((sum_sq - sum * sum / n) / (n - 1.0), 0.0);
+    }
+};
+
+// Kahan-Babuska step: `carry` holds the rounding error still owed to `sum`.
+inline void kahan_add(double& sum, double& carry, double value) {
+    const double y = value - carry;
+    const double t = sum + y;
+    carry = (t - sum) - y;
+    sum = t;
+}
+
+// Scalar loop over x[begin, n), also used for the vector kernels' tails.
+inline void accumulate_moments(const double* x, size_t begin, size_t n, SampleMoments& m,
+                               double& sum_carry, double& sq_carry) {
+    for (size_t i = begin; i < n; ++i) {
+        const double d = x[i] - m.shift;
+        kahan_add(m.sum, sum_carry, d);
+        kahan_add(m.sum_sq, sq_carry, d * d);
+        m.min = std::min(m.min, x[i]);
+        m.max = std::max(m.max, x[i]);
+    }
+}
+
+// Folds per-lane accumulators into the scalar moments.
+inline void fold_lanes(SampleMoments& m, double& sum_carry, double& sq_carry, size_t lanes,
+                       const double* sum, const double* sum_c, const double* sq, const double* sq_c,
+                       const double* lo, const double* hi) {
+    for (size_t k = 0; k < lanes; ++k) {
+        kahan_add(m.sum, sum_carry, sum[k]);
+        kahan_add(m.sum, sum_carry, -sum_c[k]);
+        kahan_add(m.sum_sq, sq_carry, sq[k]);
+        kahan_add(m.sum_sq, sq_carry, -sq_c[k]);
+        m.min = std::min(m.min, lo[k]);
+        m.max = std::max(m.max, hi[k]);
+    }
+}
+
+inline SampleMoments start_moments(const double* x, size_t n) {
+    SampleMoments m;
+    m.count = n;
+    if (n > 0) {
+        m.shift = m.min = m.max = x[0];
+    }
+    return m;
+}
+
+inline SampleMoments sample_moments_scalar(const double* x, size_t n) {
+    SampleMoments m = start_moments(x, n);
+    double sum_carry = 0.0;
+    double sq_carry = 0.0;
+    accumulate_moments(x, 0, n, m, sum_carry, sq_carry);
+    m.sum -= sum_carry;
+    m.sum_sq -= sq_carry;
+    return m;
+}
+
+// Bins of the log2 sample histogram: bin 0 holds samples below 1 ns, bin
+// b >= 1 holds [2^(b-1), 2^b) ns. The bin is read off the exponent bits.
+static constexpr size_t kLog2BinCount = 1026;
+
+inline size_t log2_bin(double ns) {
+    if (!(ns >= 1.0)) {
+        return 0;
+    }
+    uint64_t bits;
+    std::memcpy(&bits, &ns, sizeof(bits));
+    return static_cast<size_t>((bits >> 52) & 0x7ff) - 1022;
+}
+
+inline void log2_bins_scalar(const double* x, size_t begin, size_t n, uint64_t* counts) {
+    for (size_t i = begin; i < n; ++i) {
+        ++counts[log2_bin(x[i])];
+    }
+}
+
+#if defined(PERFLITE_HAS_X86_KERNELS)
+__attribute__((target("avx2"))) inline SampleMoments sample_moments_avx2(const double* x, size_t n) {
+    SampleMoments m = start_moments(x, n);
+    if (n < 4) {
+        return sample_moments_scalar(x, n);
+    }
+    const __m256d shift = _mm256_set1_pd(m.shift);
+    __m256d sum = _mm256_setzero_pd(), sum_c = _mm256_setzero_pd();
+    __m256d sq = _mm256_setzero_pd(), sq_c = _mm256_setzero_pd();
+    __m256d lo = _mm256_set1_pd(x[0]), hi = lo;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m256d v = _mm256_loadu_pd(x + i);
+        const __m256d d = _mm256_sub_pd(v, shift);
+        __m256d y = _mm256_sub_pd(d, sum_c);
+        __m256d t = _mm256_add_pd(sum, y);
+        sum_c = _mm256_sub_pd(_mm256_sub_pd(t, sum), y);
+        sum = t;
+        y = _mm256_sub_pd(_mm256_mul_pd(d, d), sq_c);
+        t = _mm256_add_pd(sq, y);
+        sq_c = _mm256_sub_pd(_mm256_sub_pd(t, sq), y);
+        sq = t;
+        lo = _mm256_min_pd(lo, v);
+        hi = _mm256_max_pd(hi, v);
+    }
+    double lanes[6][4];
+    _mm256_storeu_pd(lanes[0], sum);
+    _mm256_storeu_pd(lanes[1], sum_c);
+    _mm256_storeu_pd(lanes[2], sq);
+    _mm256_storeu_pd(lanes[3], sq_c);
+    _mm256_storeu_pd(lanes[4], lo);
+    _mm256_storeu_pd(lanes[5], hi);
+    double sum_carry = 0.0;
+    double sq_carry = 0.0;
+    fold_lanes(m, sum_carry, sq_carry, 4, lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5]);
+    accumulate_moments(x, i, n, m, sum_carry, sq_carry);
+    m.sum -= sum_carry;
+    m.sum_sq -= sq_carry;
+    return m;
+}
+
+// GCC 12 reports the undefined pass-through operand of its AVX-512
+// intrinsics as -Wmaybe-uninitialized.
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+__attribute__((target("avx512f"))) inline SampleMoments sample_moments_avx512(const double* x, size_t n) {
+    SampleMoments m = start_moments(x, n);
+    if (n < 8) {
+        return sample_moments_scalar(x, n);
+    }
+    const __m512d shift = _mm512_set1_pd(m.shift);
+    __m512d sum = _mm512_setzero_pd(), sum_c = _mm512_setzero_pd();
+    __m512d sq = _mm512_setzero_pd(), sq_c = _mm512_setzero_pd();
+    __m512d lo = _mm512_set1_pd(x[0]), hi = lo;
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m512d v = _mm512_loadu_pd(x + i);
+        const __m512d d = _mm512_sub_pd(v, shift);
+        __m512d y = _mm512_sub_pd(d, sum_c);
+        __m512d t = _mm512_add_pd(sum, y);
+        sum_c = _mm512_sub_pd(_mm512_sub_pd(t, sum), y);
+        sum = t;
+        y = _mm512_sub_pd(_mm512_mul_pd(d, d), sq_c);
+        t = _mm512_add_pd(sq, y);
+        sq_c = _mm512_sub_pd(_mm512_sub_pd(t, sq), y);
+        sq = t;
+        lo = _mm512_min_pd(lo, v);
+        hi = _mm512_max_pd(hi, v);
+    }
+    double lanes[6][8];
+    _mm512_storeu_pd(lanes[0], sum);
+    _mm512_storeu_pd(lanes[1], sum_c);
+    _mm512_storeu_pd(lanes[2], sq);
+    _mm512_storeu_pd(lanes[3], sq_c);
+    _mm512_storeu_pd(lanes[4], lo);
+    _mm512_storeu_pd(lanes[5], hi);
+    double sum_carry = 0.0;
+    double sq_carry = 0.0;
+    fold_lanes(m, sum_carry, sq_carry, 8, lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5]);
+    accumulate_moments(x, i, n, m, sum_carry, sq_carry);
+    m.sum -= sum_carry;
+    m.sum_sq -= sq_carry;
+    return m;
+}
+
+// Bin indices are computed four (eight) at a time; the increments stay
+// scalar since lanes often hit the same bin.
+__attribute__((target("avx2"))) inline void log2_bins_avx2(const double* x, size_t n, uint64_t* counts) {
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256i exponent_mask = _mm256_set1_epi64x(0x7ff);
+    const __m256i bias = _mm256_set1_epi64x(1022);
+    size_t i = 0;
+    uint64_t bins[4];
+    for (; i + 4 <= n; i += 4) {
+        const __m256d v = _mm256_loadu_pd(x + i);
+        const __m256i exponent = _mm256_and_si256(_mm256_srli_epi64(_mm256_castpd_si256(v), 52), exponent_mask);
+        const __m256i at_least_one = _mm256_castpd_si256(_mm256_cmp_pd(v, one, _CMP_GE_OQ));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(bins),
+                            _mm256_and_si256(_mm256_sub_epi64(exponent, bias), at_least_one));
+        ++counts[bins[0]];
+        ++counts[bins[1]];
+        ++counts[bins[2]];
+        ++counts[bins[3]];
+    }
+    log2_bins_scalar(x, i, n, counts);
+}
+
+__attribute__((target("avx512f"))) inline void log2_bins_avx512(const double* x, size_t n, uint64_t* counts) {
+    const __m512d one = _mm512_set1_pd(1.0);
+    const __m512i exponent_mask = _mm512_set1_epi64(0x7ff);
+    const __m512i bias = _mm512_set1_epi64(1022);
+    size_t i = 0;
+    uint64_t bins[8];
+    for (; i + 8 <= n; i += 8) {
+        const __m512d v = _mm512_loadu_pd(x + i);
+        const __m512i exponent = _mm512_and_si512(_mm512_srli_epi64(_mm512_castpd_si512(v), 52), exponent_mask);
+        const __mmask8 at_least_one = _mm512_cmp_pd_mask(v, one, _CMP_GE_OQ);
+        _mm512_storeu_si512(bins, _mm512_maskz_mov_epi64(at_least_one, _mm512_sub_epi64(exponent, bias)));
+        for (size_t k = 0; k < 8; ++k) {
+            ++counts[bins[k]];
+        }
+    }
+    log2_bins_scalar(x, i, n, counts);
+}
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
+
+#if defined(PERFLITE_HAS_NEON_KERNELS)
+inline SampleMoments sample_moments_neon(const double* x, size_t n) {
+    SampleMoments m = start_moments(x, n);
+    if (n < 2) {
+        return sample_moments_scalar(x, n);
+    }
+    const float64x2_t shift = vdupq_n_f64(m.shift);
+    float64x2_t sum = vdupq_n_f64(0.0), sum_c = sum, sq = sum, sq_c = sum;
+    float64x2_t lo = vdupq_n_f64(x[0]), hi = lo;
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2) {
+        const float64x2_t v = vld1q_f64(x + i);
+        const float64x2_t d = vsubq_f64(v, shift);
+        float64x2_t y = vsubq_f64(d, sum_c);
+        float64x2_t t = vaddq_f64(sum, y);
+        sum_c = vsubq_f64(vsubq_f64(t, sum), y);
+        sum = t;
+        y = vsubq_f64(vmulq_f64(d, d), sq_c);
+        t = vaddq_f64(sq, y);
+        sq_c = vsubq_f64(vsubq_f64(t, sq), y);
+        sq = t;
+        lo = vminq_f64(lo, v);
+        hi = vmaxq_f64(hi, v);
+    }
+    double lanes[6][2];
+    vst1q_f64(lanes[0], sum);
+    vst1q_f64(lanes[1], sum_c);
+    vst1q_f64(lanes[2], sq);
+    vst1q_f64(lanes[3], sq_c);
+    vst1q_f64(lanes[4], lo);
+    vst1q_f64(lanes[5], hi);
+    double sum_carry = 0.0;
+    double sq_carry = 0.0;
+    fold_lanes(m, sum_carry, sq_carry, 2, lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5]);
+    accumulate_moments(x, i, n, m, sum_carry, sq_carry);
+    m.sum -= sum_carry;
+    m.sum_sq -= sq_carry;
+    return m;
+}
+
+inline void log2_bins_neon(const double* x, size_t n, uint64_t* counts) {
+    const float64x2_t one = vdupq_n_f64(1.0);
+    const uint64x2_t exponent_mask = vdupq_n_u64(0x7ff);
+    const uint64x2_t bias = vdupq_n_u64(1022);
+    size_t i = 0;
+    uint64_t bins[2];
+    for (; i + 2 <= n; i += 2) {
+        const float64x2_t v = vld1q_f64(x + i);
+        const uint64x2_t exponent = vandq_u64(vshrq_n_u64(vreinterpretq_u64_f64(v), 52), exponent_mask);
+        vst1q_u64(bins, vandq_u64(vsubq_u64(exponent, bias), vcgeq_f64(v, one)));
+        ++counts[bins[0]];
+        ++counts[bins[1]];
+    }
+    log2_bins_scalar(x, i, n, counts);
+}
+#endif
+
+// Moments of x[0, n) with the widest kernel available at `level`.
+inline SampleMoments sample_moments(const double* x, size_t n, SimdLevel level = simd_level()) {
+    switch (level) {
+#if defined(PERFLITE_HAS_X86_KERNELS)
+    case SimdLevel::Avx512:
+        return sample_moments_avx512(x, n);
+    case SimdLevel::Avx2:
+        return sample_moments_avx2(x, n);
+#elif defined(PERFLITE_HAS_NEON_KERNELS)
+    case SimdLevel::Neon:
+        return sample_moments_neon(x, n);
+#endif
+    default:
+        return sample_moments_scalar(x, n);
+    }
+}
+
+// Adds the log2 bins of x[0, n) to counts[kLog2BinCount].
+inline void log2_bin_counts(const double* x, size_t n, uint64_t* counts, SimdLevel level = simd_level()) {
+    switch (level) {
+#if defined(PERFLITE_HAS_X86_KERNELS)
+    case SimdLevel::Avx512:
+        log2_bins_avx512(x, n, counts);
+        return;
+    case SimdLevel::Avx2:
+        log2_bins_avx2(x, n, counts);
+        return;
+#elif defined(PERFLITE_HAS_NEON_KERNELS)
+    case SimdLevel::Neon:
+        log2_bins_neon(x, n, counts);
+        return;
+#endif
+    default:
+        log2_bins_scalar(x, 0, n, counts);
+    }
+}
+
+// Partially orders [first, last) so that every listed rank (ascending,
+// unique, counted from `offset`) holds the value a full sort would put
+// there, with smaller values before it and larger ones after. Costs about
+// O(n log k) for k ranks instead of O(n log n).
+inline void select_ranks(double* first, double* last, const size_t* rank_first, const size_t* rank_last,
+                         size_t offset = 0) {
+    if (rank_first == rank_last || first == last) {
+        return;
+    }
+    const size_t* mid = rank_first + (rank_last - rank_first) / 2;
+    double* nth = first + (*mid - offset);
+    std::nth_element(first, nth, last);
+    select_ranks(first, nth, rank_first, mid, offset);
+    select_ranks(nth + 1, last, mid + 1, rank_last, *mid + 1);
+}
+
+// Index of the most significant set bit (value must be non-zero).
+inline unsigned highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63u - static_cast<unsigned>(__builtin_clzll(value));
+#else
+    unsigned bit = 0;
+    while (value >>= 1) {
+        ++bit;
+    }
+    return bit;
+#endif
+}
+
+} // namespace detail
+
+// Reusable barrier that busy-waits instead of sleeping, so that all threads
+// leave it within a few hundred nanoseconds of each other.
+class SpinBarrier {
+public:
+    explicit SpinBarrier(size_t count) : count_(count), waiting_(0), generation_(0) {}
+
+    void arrive_and_wait() {
+        const size_t generation = generation_.load(std::memory_order_acquire);
+        if (waiting_.fetch_add(1, std::memory_order_acq_rel) + 1 == count_) {
+            waiting_.store(0, std::memory_order_relaxed);
+            generation_.fetch_add(1, std::memory_order_release);
+            return;
+        }
+        // Yield now and then so oversubscribed machines still make progress.
+        for (unsigned spins = 1; generation_.load(std::memory_order_acquire) == generation; ++spins) {
+            if (spins % 4096 == 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    const size_t count_;
+    std::atomic<size_t> waiting_;
+    std::atomic<size_t> generation_;
+};
+
+// Fixed-size log-linear histogram of nanosecond values (HDR-style).
+// Each power of two is split into 64 linear sub-buckets, giving ~1.6% relative
+// error over 1/16 ns .. ~4.8 hours in a fixed 2752-bucket table.
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 6;
+    static constexpr uint64_t kSubBucketCount = uint64_t(1) << kSubBucketBits;
+    static constexpr unsigned kMaxBits = 48;
+    static constexpr double kUnitsPerNs = 16.0;
+    static constexpr size_t kBucketCount = kSubBucketCount + (kMaxBits - kSubBucketBits) * kSubBucketCount;
+
+    // Allocates and zeroes the bucket table so that record() never allocates.
+    void prepare() {
+        counts_.assign(kBucketCount, 0);
+        total_ = 0;
+    }
+
+    // Records one value in nanoseconds.
+    void record(double ns, uint64_t count = 1) {
+        if (counts_.empty()) {
+            prepare();
+        }
+        counts_[index_of(ns)] += count;
+        total_ += count;
+    }
+
+    // Adds all counts of another histogram.
+    void merge(const LatencyHistogram& other) {
+        if (other.counts_.empty()) {
+            return;
+        }
+        if (counts_.empty()) {
+            prepare();
+        }
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        total_ += other.total_;
+    }
+
+    uint64_t total() const { return total_; }
+    size_t bucket_count() const { return counts_.size(); }
+    uint64_t bucket(size_t index) const { return counts_[index]; }
+
+    // Inclusive lower and exclusive upper bound of a bucket, in nanoseconds.
+    static double bucket_lower(size_t index) { return static_cast<double>(lower_units(index)) / kUnitsPerNs; }
+    static double bucket_upper(size_t index) {
+        return static_cast<double>(lower_units(index) + width_units(index)) / kUnitsPerNs;
+    }
+
+    // Value below which a fraction q (0..1) of the samples fall, reported as
+    // the midpoint of the containing bucket.
+    double quantile(double q) const {
+        if (total_ == 0) {
+            return 0.0;
+        }
+        q = std::min(std::max(q, 0.0), 1.0);
+        const uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(q * static_cast<double>(total_))));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < counts_.size(); ++i) {
+            seen += counts_[i];
+            if (seen >= rank) {
+                return 0.5 * (bucket_lower(i) + bucket_upper(i));
+            }
+        }
+        return bucket_upper(counts_.size() - 1);
+    }
+
+    // Bucket index of a value in nanoseconds.
+    static size_t index_of(double ns) {
+        const double scaled = ns * kUnitsPerNs;
+        const uint64_t max_units = (uint64_t(1) << kMaxBits) - 1;
+        uint64_t units = (scaled <= 0.0) ? 0
+                       : (scaled >= static_cast<double>(max_units)) ? max_units
+                       : static_cast<uint64_t>(scaled);
+        if (units < kSubBucketCount) {
+            return static_cast<size_t>(units);
+        }
+        const unsigned exponent = detail::highest_bit(units);
+        const unsigned shift = exponent - kSubBucketBits;
+        return static_cast<size_t>(kSubBucketCount + shift * kSubBucketCount +
+                                   ((units >> shift) - kSubBucketCount));
+    }
+
+private:
+    static uint64_t lower_units(size_t index) {
+        if (index < kSubBucketCount) {
+            return index;
+        }
+        const uint64_t k = index - kSubBucketCount;
+        const uint64_t shift = k / kSubBucketCount;
+        return (k % kSubBucketCount + kSubBucketCount) << shift;
+    }
+
+    static uint64_t width_units(size_t index) {
+        return (index < kSubBucketCount) ? 1 : uint64_t(1) << ((index - kSubBucketCount) / kSubBucketCount);
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+};
+
+// O(1)-memory accumulator for streaming mode: Welford mean and variance,
+// min/max and a LatencyHistogram for quantiles. Samples are in nanoseconds.
+struct OnlineStatistics {
+    uint64_t count = 0;
+    double mean = 0.0;
+    double m2 = 0.0;
+    double min = 0.0;
+    double max = 0.0;
+    LatencyHistogram histogram;
+
+    // Resets the accumulator and allocates the histogram up front.
+    void prepare() {
+        count = 0;
+        mean = m2 = min = max = 0.0;
+        histogram.prepare();
+    }
+
+    void add(double ns) {
+        ++count;
+        const double delta = ns - mean;
+        mean += delta / static_cast<double>(count);
+        m2 += delta * (ns - mean);
+        if (count == 1) {
+            min = max = ns;
+        } else {
+            min = std::min(min, ns);
+            max = std::max(max, ns);
+        }
+        histogram.record(ns);
+    }
+
+    // Combines another accumulator into this one (Chan et al. parallel update).
+    void merge(const OnlineStatistics& other) {
+        if (other.count == 0) {
+            return;
+        }
+        if (count == 0) {
+            *this = other;
+            return;
+        }
+        const double total = static_cast<double>(count + other.count);
+        const double delta = other.mean - mean;
+        m2 += other.m2 + delta * delta * static_cast<double>(count) * static_cast<double>(other.count) / total;
+        mean += delta * static_cast<double>(other.count) / total;
+        count += other.count;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        histogram.merge(other.histogram);
+    }
+
+    // Sample variance (n - 1 denominator).
+    double variance() const {
+        return (count > 1) ? m2 / static_cast<double>(count - 1) : 0.0;
+    }
+
+    // Approximate quantile, clamped to the exact observed range.
+    double quantile(double q) const {
+        return std::min(std::max(histogram.quantile(q), min), max);
+    }
+};
+
+// One requested percentile of the sample distribution.
+struct Percentile {
+    double level;  // Percent, e.g. 99.9
+    double time;   // Value in the result's time unit
+};
+
+// One power-of-two bucket of the reported latency histogram.
+struct HistogramBin {
+    double lower;    // Inclusive bound in the result's time unit
+    double upper;    // Exclusive bound in the result's time unit
+    uint64_t count;
+};
+
+// Machine state captured before a run, so that results taken under
+// different conditions can be told apart later.
+struct EnvironmentInfo {
+    unsigned logical_cpus = 0;
+    std::string cpu_model;
+    std::string governor;      // cpufreq scaling governor ("" if unknown)
+    int turbo = -1;            // 1 = enabled, 0 = disabled, -1 = unknown
+    double load_average = -1;  // 1-minute load average (-1 if unknown)
+    int pinned_cpu = -1;       // CPU the benchmark thread was pinned to (-1 = not pinned)
+    bool high_priority = false;
+
+    // Reads the current state; `cpu` selects which CPU's governor to report.
+    static EnvironmentInfo capture(int cpu = -1) {
+        EnvironmentInfo env;
+        env.logical_cpus = std::thread::hardware_concurrency();
+#if defined(__linux__)
+        static const std::string model = [] {
+            std::ifstream in("/proc/cpuinfo");
+            std::string line;
+            while (std::getline(in, line)) {
+                if (line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0) {
+                    const size_t colon = line.find(':');
+                    return (colon == std::string::npos) ? std::string() : line.substr(colon + 2);
+                }
+            }
+            return std::string();
+        }();
+        env.cpu_model = model;
+        const std::string cpu_dir = "/sys/devices/system/cpu/cpu" + std::to_string(std::max(cpu, 0));
+        env.governor = detail::read_first_line(cpu_dir + "/cpufreq/scaling_governor");
+        const std::string no_turbo = detail::read_first_line("/sys/devices/system/cpu/intel_pstate/no_turbo");
+        const std::string boost = detail::read_first_line("/sys/devices/system/cpu/cpufreq/boost");
+        if (!no_turbo.empty()) {
+            env.turbo = (no_turbo == "0") ? 1 : 0;
+        } else if (!boost.empty()) {
+            env.turbo = (boost == "1") ? 1 : 0;
+        }
+        double load[1];
+        if (getloadavg(load, 1) == 1) {
+            env.load_average = load[0];
+        }
+#else
+        (void)cpu;
+#endif
+        return env;
+    }
+
+    // Writes one warning line per condition that makes timings unstable.
+    // Returns the number of warnings.
+    int warn(std::ostream& os = std::cerr) const {
+        int warnings = 0;
+        if (!governor.empty() && governor != "performance") {
+            os << "Warning: CPU frequency governor is '" << governor
+               << "'; use 'performance' for stable results\n";
+            ++warnings;
+        }
+        if (turbo == 1) {
+            os << "Warning: CPU turbo/boost is enabled; results may vary with temperature and load\n";
+            ++warnings;
+        }
+        const double busy = std::max(1.0, 0.5 * static_cast<double>(logical_cpus));
+        if (load_average > busy) {
+            os << "Warning: system load average is " << load_average
+               << "; other processes may disturb the measurement\n";
+            ++warnings;
+        }
+        return warnings;
+    }
+};
+
+// Samples outside Tukey's fences: mild beyond 1.5 IQR from the quartiles,
+// severe beyond 3 IQR.
+struct OutlierCounts {
+    uint64_t low_severe = 0;
+    uint64_t low_mild = 0;
+    uint64_t high_mild = 0;
+    uint64_t high_severe = 0;
+
+    uint64_t total() const { return low_severe + low_mild + high_mild + high_severe; }
+};
+
+// Cache state at the start of each sample: Warm reuses whatever the warmup
+// and previous calls left in the caches; Cold evicts the data caches
+// before every call (outside the timed region).
+enum class CacheMode {
+    Warm,
+    Cold
+};
+
+// Arrival process of the open-loop load generator: evenly spaced calls, or
+// exponentially distributed gaps (Poisson arrivals) at the same mean rate.
+enum class Arrivals {
+    Constant,
+    Poisson
+};
+
+// Statistic whose confidence interval drives adaptive stopping.
+enum class StopStatistic {
+    Mean,
+    Median
+};
+
+// Structure to hold benchmark results and compute statistics.
+struct BenchmarkResult {
+    std::string name;
+    std::vector<std::chrono::duration<double, std::nano>> durations;
+    std::vector<double> sample_starts_ns;  // Steady-clock start of each sample, if record_timestamps()
+    double min_time;
+    double mean_time;
+    double stddev_time;
+    double ops_per_sec;
+    TimeUnit time_unit;
+    size_t iterations;   // Total number of measured calls
+    size_t batch_size;   // Calls per recorded sample (1 = unbatched)
+    double overhead_ns;      // Estimated harness overhead per call, in nanoseconds
+    bool subtract_overhead;  // Whether overhead_ns is removed from the location statistics
+    double overhead_time;    // overhead_ns in the output time unit
+    ClockSource clock;       // Clock backend used for the measurement
+    double cycles_per_ns;    // Counter ticks per nanosecond (0 if the clock has no cycle counter)
+    double min_cycles;       // min_time expressed in counter ticks
+    double mean_cycles;      // mean_time expressed in counter ticks
+    size_t sample_count;     // Number of samples the statistics were computed from
+    OnlineStatistics online; // Streaming accumulator (used when durations is empty)
+    double median_time;
+    double max_time;
+    double mad_time;                          // Median absolute deviation
+    std::vector<double> percentile_levels;    // Percentiles to report, in percent
+    std::vector<Percentile> percentiles;      // Computed values for percentile_levels
+    std::vector<HistogramBin> histogram;      // Log2-bucketed sample counts
+    std::vector<CounterValue> counters;       // Hardware counters per iteration (empty if unavailable)
+    double ipc;                               // Instructions per cycle (0 if not measured)
+    size_t threads;                           // Number of threads that ran the function
+    std::vector<double> thread_ops_per_sec;   // Wall-clock throughput of each thread
+    double aggregate_ops_per_sec;             // Sum of thread_ops_per_sec
+    double scaling_efficiency;                // aggregate / (threads * single-thread throughput)
+    EnvironmentInfo environment;              // Machine state at the start of the run
+    size_t complexity_n;                      // Input size of a range benchmark point (0 = none)
+    bool allocations_tracked;                 // Whether the allocation fields below were measured
+    double allocations_per_iteration;         // Heap allocations per measured call
+    double allocated_bytes_per_iteration;     // Bytes requested from operator new per call
+    uint64_t peak_live_bytes;                 // Peak net heap growth during the measured loop
+    bool memory_tracked;                      // Whether the fault, switch and RSS fields below were measured
+    double minor_faults_per_iteration;        // Page faults served without I/O, per measured call
+    double major_faults_per_iteration;        // Page faults that needed I/O, per measured call
+    double voluntary_switches_per_iteration;  // Context switches from blocking, per measured call
+    double involuntary_switches_per_iteration;  // Preemptions, per measured call
+    int64_t rss_growth_bytes;                 // Resident set at the end minus at the start of the loop
+    uint64_t peak_rss_growth_bytes;           // Peak resident set during the loop above its starting level
+    size_t warmup_iterations;                 // Configured warmup calls before calibration
+    double target_duration_ns;                // Configured target duration of the measured loop
+    bool streaming;                           // Whether samples were streamed (durations left empty)
+    double confidence_target;                 // Requested relative CI half-width (0 = fixed sample count)
+    double confidence_half_width;             // Achieved relative 95% CI half-width of the stop statistic
+    bool converged;                           // Whether confidence_target was reached before max_time
+    size_t repetition;                        // Index of this run among repeated runs (0-based)
+    OutlierCounts outliers;                   // Tukey-fence classification of the samples
+    double outlier_fraction;                  // outliers.total() / sample_count
+    double trim_fraction;                     // Share cut from each tail for trimmed_mean_time (0 = off)
+    double trimmed_mean_time;
+    double inlier_mean_time;                  // Mean of the samples inside the mild fences
+    double inlier_stddev_time;                // StdDev of the samples inside the mild fences
+    double bytes_per_iteration;               // Bytes processed per call (0 = not reported)
+    double items_per_iteration;               // Items processed per call (0 = not reported)
+    double bytes_per_sec;                     // bytes_per_iteration at the mean call rate
+    double items_per_sec;                     // items_per_iteration at the mean call rate
+    CacheMode cache_mode;                     // Cache state each sample started from
+    size_t jobs;                              // Suite workers running at the same time (1 = alone)
+    size_t queue_depth;                       // Operations in flight for run_async() (0 = synchronous)
+    double offered_ops_per_sec;               // Open-loop arrival rate (0 = closed loop)
+    Arrivals arrivals;                        // Open-loop arrival process
+    double service_mean_time;                 // Open loop: mean time from actual start to completion
+    double co_run_slowdown;                   // Mean slowdown against a solo rerun (0 = not checked)
+
+    // Constructor initializes all fields to safe defaults.
+    explicit BenchmarkResult(TimeUnit unit = TimeUnit::Nanoseconds)
+        : min_time(0.0), mean_time(0.0), stddev_time(0.0), ops_per_sec(0.0), time_unit(unit),
+          iterations(0), batch_size(1), overhead_ns(0.0), subtract_overhead(false), overhead_time(0.0),
+          clock(ClockSource::Chrono), cycles_per_ns(0.0), min_cycles(0.0), mean_cycles(0.0), sample_count(0),
+          median_time(0.0), max_time(0.0), mad_time(0.0), percentile_levels{50.0, 90.0, 99.0, 99.9}, ipc(0.0),
+          threads(1), aggregate_ops_per_sec(0.0), scaling_efficiency(0.0), complexity_n(0),
+          allocations_tracked(false), allocations_per_iteration(0.0), allocated_bytes_per_iteration(0.0),
+          peak_live_bytes(0), memory_tracked(false), minor_faults_per_iteration(0.0),
+          major_faults_per_iteration(0.0), voluntary_switches_per_iteration(0.0),
+          involuntary_switches_per_iteration(0.0), rss_growth_bytes(0), peak_rss_growth_bytes(0),
+          warmup_iterations(0), target_duration_ns(0.0), streaming(false),
+          confidence_target(0.0), confidence_half_width(0.0), converged(false), repetition(0),
+          outlier_fraction(0.0), trim_fraction(0.0), trimmed_mean_time(0.0), inlier_mean_time(0.0),
+          inlier_stddev_time(0.0), bytes_per_iteration(0.0), items_per_iteration(0.0), bytes_per_sec(0.0),
+          items_per_sec(0.0), cache_mode(CacheMode::Warm), jobs(1), queue_depth(0), offered_ops_per_sec(0.0),
+          arrivals(Arrivals::Constant),
+          service_mean_time(0.0), co_run_slowdown(0.0) {}
+
+    // Returns the per-iteration value of a named hardware counter, or 0 if it
+    // was not measured.
+    double counter(const std::string& counter_name) const {
+        for (const auto& c : counters) {
+            if (c.name == counter_name) {
+                return c.per_iteration;
+            }
+        }
+        return 0.0;
+    }
+
+    // Returns the computed value for a requested percentile level, or 0 if
+    // that level was not requested.
+    double percentile(double level) const {
+        for (const auto& p : percentiles) {
+            if (std::abs(p.level - level) < 1e-9) {
+                return p.time;
+            }
+        }
+        return 0.0;
+    }
+
+    // Share of outlying samples above which calculate_statistics() warns.
+    static constexpr double kNoisyOutlierFraction = 0.1;
+
+    // co_run_slowdown above which a benchmark is reported as sensitive to
+    // co-running (typically memory-bandwidth bound).
+    static constexpr double kCoRunSensitivity = 0.1;
+
+    // Calculates statistics from collected durations, or from the online
+    // accumulator when the benchmark ran in streaming mode.
+    // Converts results to the specified time unit.
+    void calculate_statistics() {
+        if (durations.empty() && online.count == 0) {
+            std::cerr << "Warning: No durations recorded for benchmark '" << name << "'\n";
+            return;
+        }
+
+        // 1. Determine the conversion factor to the target unit
+        double divisor = 1.0;
+        if (time_unit == TimeUnit::Milliseconds) divisor = 1e6;
+        else if (time_unit == TimeUnit::Microseconds) divisor = 1e3;
+        else if (time_unit == TimeUnit::Nanoseconds) divisor = 1.0;
+        else divisor = 1e9; // Seconds
+
+        // 2. Calculate Stats in high-precision double nanoseconds.
+        // This prevents 0.0002ms from becoming 0.
+        double mean_ns = 0.0;
+        double min_ns = 0.0;
+        double max_ns = 0.0;
+        double variance_ns = 0.0;
+        if (!durations.empty()) {
+            sample_count = durations.size();
+
+            // 3. Sum, compensated sum of squares and range in one vectorized pass
+            const detail::SampleMoments moments = detail::sample_moments(raw_samples(), durations.size());
+            mean_ns = moments.mean();
+            min_ns = moments.min;
+            max_ns = moments.max;
+            variance_ns = moments.variance();
+        } else {
+            // 3. Streaming mode: the accumulator already holds Welford moments.
+            sample_count = static_cast<size_t>(online.count);
+            mean_ns = online.mean;
+            min_ns = online.min;
+            max_ns = online.max;
+            variance_ns = online.variance();
+        }
+
+        // Median, percentiles and MAD: exact from the raw samples, otherwise
+        // approximated from the streaming histogram.
+        double median_ns = 0.0;
+        double mad_ns = 0.0;
+        std::vector<double> percentiles_ns(percentile_levels.size(), 0.0);
+        TailSummary tails;
+        if (!durations.empty()) {
+            const size_t n = durations.size();
+            std::vector<double> ranked_ns(raw_samples(), raw_samples() + n);
+            // Only the ranks read below are put in place, not a full sort
+            std::vector<size_t> ranks;
+            add_quantile_ranks(ranks, n, 0.25);
+            add_quantile_ranks(ranks, n, 0.5);
+            add_quantile_ranks(ranks, n, 0.75);
+            for (const double level : percentile_levels) {
+                add_quantile_ranks(ranks, n, level / 100.0);
+            }
+            // The trim boundaries, so that summarize_tails() sees every
+            // sample in the right rank block
+            if (trim_fraction > 0.0) {
+                const double cut = trim_fraction * static_cast<double>(n);
+                ranks.push_back(std::min(static_cast<size_t>(cut), n - 1));
+                ranks.push_back(std::min(static_cast<size_t>(static_cast<double>(n) - cut), n - 1));
+            }
+            select_ranks(ranked_ns, ranks);
+            median_ns = ranked_quantile(ranked_ns, 0.5);
+            for (size_t i = 0; i < percentile_levels.size(); ++i) {
+                percentiles_ns[i] = ranked_quantile(ranked_ns, percentile_levels[i] / 100.0);
+            }
+            tails = summarize_tails([&ranked_ns](auto&& visit) {
+                for (const double v : ranked_ns) {
+                    visit(v, 1.0);
+                }
+            }, static_cast<double>(n), ranked_quantile(ranked_ns, 0.25), ranked_quantile(ranked_ns, 0.75));
+            for (double& v : ranked_ns) {
+                v = std::abs(v - median_ns);
+            }
+            ranks.clear();
+            add_quantile_ranks(ranks, n, 0.5);
+            select_ranks(ranked_ns, ranks);
+            mad_ns = ranked_quantile(ranked_ns, 0.5);
+        } else {
+            median_ns = online.quantile(0.5);
+            for (size_t i = 0; i < percentile_levels.size(); ++i) {
+                percentiles_ns[i] = online.quantile(percentile_levels[i] / 100.0);
+            }
+            mad_ns = histogram_mad(online.histogram, median_ns);
+            const LatencyHistogram& h = online.histogram;
+            tails = summarize_tails([&h](auto&& visit) {
+                for (size_t i = 0; i < h.bucket_count(); ++i) {
+                    if (h.bucket(i) > 0) {
+                        visit(0.5 * (LatencyHistogram::bucket_lower(i) + LatencyHistogram::bucket_upper(i)),
+                              static_cast<double>(h.bucket(i)));
+                    }
+                }
+            }, static_cast<double>(h.total()), online.quantile(0.25), online.quantile(0.75));
+        }
+        outliers = tails.outliers;
+        outlier_fraction = (sample_count > 0) ? static_cast<double>(outliers.total()) / sample_count : 0.0;
+        if (outlier_fraction > kNoisyOutlierFraction) {
+            std::ostringstream percent;
+            percent << std::fixed << std::setprecision(1) << outlier_fraction * 100.0;
+            std::cerr << "Warning: " << percent.str() << "% of the samples of '" << name
+                      << "' are outliers; the environment may be too noisy\n";
+        }
+        inlier_stddev_time = std::sqrt(tails.inlier_variance_ns) / divisor;
+        
+        // Convert StdDev to target unit
+        stddev_time = std::sqrt(variance_ns) / divisor;
+
+        // 4. Remove the harness overhead from the location estimates if requested.
+        // The spread is unaffected by a constant shift.
+        overhead_time = overhead_ns / divisor;
+        if (subtract_overhead) {
+            mean_ns = std::max(mean_ns - overhead_ns, 0.0);
+            min_ns = std::max(min_ns - overhead_ns, 0.0);
+            max_ns = std::max(max_ns - overhead_ns, 0.0);
+            median_ns = std::max(median_ns - overhead_ns, 0.0);
+            tails.trimmed_mean_ns = std::max(tails.trimmed_mean_ns - overhead_ns, 0.0);
+            tails.inlier_mean_ns = std::max(tails.inlier_mean_ns - overhead_ns, 0.0);
+            for (double& p : percentiles_ns) {
+                p = std::max(p - overhead_ns, 0.0);
+            }
+        }
+        mean_time = mean_ns / divisor;
+        min_time = min_ns / divisor;
+        max_time = max_ns / divisor;
+        median_time = median_ns / divisor;
+        mad_time = mad_ns / divisor;
+        trimmed_mean_time = tails.trimmed_mean_ns / divisor;
+        inlier_mean_time = tails.inlier_mean_ns / divisor;
+        percentiles.clear();
+        for (size_t i = 0; i < percentile_levels.size(); ++i) {
+            percentiles.push_back(Percentile{percentile_levels[i], percentiles_ns[i] / divisor});
+        }
+        mean_cycles = mean_ns * cycles_per_ns;
+        min_cycles = min_ns * cycles_per_ns;
+
+        // 5. Ops per second (Always use NS for this)
+        ops_per_sec = (mean_ns > 0) ? (1e9 / mean_ns) : 0.0;
+        bytes_per_sec = bytes_per_iteration * ops_per_sec;
+        items_per_sec = items_per_iteration * ops_per_sec;
+
+        // 6. Log2-bucketed histogram of the raw samples
+        build_histogram(divisor);
+    }
+
+    // Prints results to the specified output stream with unit-appropriate precision.
+    void print(std::ostream& os = std::cout) const {
+        // Adjust precision based on time unit
+        int precision = (time_unit == TimeUnit::Nanoseconds) ? 2 : 
+                        (time_unit == TimeUnit::Microseconds) ? 3 :
+                        (time_unit == TimeUnit::Milliseconds) ? 4 : 6;
+        os << std::fixed << std::setprecision(precision);
+        os << "Benchmark: " << name << "\n";
+        os << "  Min:      " << min_time << " " << time_unit_to_string() << "\n";
+        os << "  Mean:     " << mean_time << " " << time_unit_to_string() << "\n";
+        os << "  StdDev:   " << stddev_time << " " << time_unit_to_string() << "\n";
+        if (overhead_ns > 0.0) {
+            os << "  Overhead: " << overhead_time << " " << time_unit_to_string()
+               << (subtract_overhead ? " (subtracted)" : "") << "\n";
+        }
+        if (cycles_per_ns > 0.0) {
+            os << "  Cycles:   " << min_cycles << " min, " << mean_cycles << " mean\n";
+        }
+        os << "  Median:   " << median_time << " " << time_unit_to_string() << "\n";
+        os << "  MAD:      " << mad_time << " " << time_unit_to_string() << "\n";
+        for (const auto& p : percentiles) {
+            std::ostringstream label;
+            label << "p" << std::defaultfloat << p.level << ":";
+            os << "  " << std::left << std::setw(10) << label.str() << std::right
+               << p.time << " " << time_unit_to_string() << "\n";
+        }
+        os << "  Max:      " << max_time << " " << time_unit_to_string() << "\n";
+        if (batch_size > 1) {
+            os << "  Samples:  " << sample_count << " x " << batch_size << " calls\n";
+        }
+        os << "  Ops/sec:  " << ops_per_sec << "\n";
+        if (bytes_per_sec > 0.0) {
+            const double gb = bytes_per_sec / 1e9;
+            os << "  Bytes/s:  " << ((gb >= 1.0) ? gb : bytes_per_sec / 1e6) << ((gb >= 1.0) ? " GB/s" : " MB/s")
+               << " (" << bytes_per_iteration << " bytes per iteration)\n";
+        }
+        if (items_per_sec > 0.0) {
+            os << "  Items/s:  " << items_per_sec << " (" << items_per_iteration << " per iteration)\n";
+        }
+        print_environment(os);
+        if (threads > 1) {
+            os << "  Threads:  " << threads << " (aggregate " << aggregate_ops_per_sec << " ops/sec, "
+               << std::setprecision(1) << scaling_efficiency * 100.0 << "% scaling efficiency)\n";
+            os << std::setprecision(precision);
+            for (size_t t = 0; t < thread_ops_per_sec.size(); ++t) {
+                os << "    thread " << t << ": " << thread_ops_per_sec[t] << " ops/sec\n";
+            }
+        }
+        if (outliers.total() > 0) {
+            os << "  Outliers: " << outliers.total() << " (" << outlier_fraction * 100.0 << " %): "
+               << outliers.low_severe << " low severe, " << outliers.low_mild << " low mild, "
+               << outliers.high_mild << " high mild, " << outliers.high_severe << " high severe\n";
+            os << "  Inliers:  " << inlier_mean_time << " ± " << inlier_stddev_time << " " << time_unit_to_string() << "\n";
+        }
+        if (trim_fraction > 0.0) {
+            os << "  Trimmed:  " << trimmed_mean_time << " " << time_unit_to_string() << " ("
+               << trim_fraction * 100.0 << " % per tail)\n";
+        }
+        if (cache_mode == CacheMode::Cold) {
+            os << "  Cache:    cold (evicted before every call)\n";
+        }
+        if (queue_depth > 0) {
+            os << "  Async:    queue depth " << queue_depth << ", " << aggregate_ops_per_sec << " ops/sec sustained\n";
+        }
+        if (offered_ops_per_sec > 0.0) {
+            os << "  Open loop: offered " << offered_ops_per_sec << " ops/sec ("
+               << (arrivals == Arrivals::Poisson ? "poisson" : "constant") << "), achieved " << aggregate_ops_per_sec
+               << " ops/sec, service mean " << service_mean_time << " " << time_unit_to_string() << "\n";
+        }
+        if (confidence_target > 0.0) {
+            os << "  Adaptive: " << sample_count << " samples, CI ±" << confidence_half_width * 100.0 << " % ("
+               << (converged ? "reached" : "max time hit before") << " target " << confidence_target * 100.0 << " %)\n";
+        }
+        if (allocations_tracked) {
+            os << "  Allocs:   " << allocations_per_iteration << " per iteration, "
+               << allocated_bytes_per_iteration << " bytes per iteration, peak live " << peak_live_bytes << " bytes\n";
+        }
+        if (memory_tracked) {
+            os << "  Memory:   RSS growth " << rss_growth_bytes << " bytes (peak " << peak_rss_growth_bytes
+               << "), faults " << minor_faults_per_iteration << " minor / " << major_faults_per_iteration
+               << " major per iteration\n";
+            os << "  Switches: " << voluntary_switches_per_iteration << " voluntary / "
+               << involuntary_switches_per_iteration << " involuntary per iteration\n";
+        }
+        if (!counters.empty()) {
+            os << "  Counters (per iteration):\n";
+            for (const auto& c : counters) {
+                os << "    " << std::left << std::setw(14) << c.name << std::right << c.per_iteration << "\n";
+            }
+            if (ipc > 0.0) {
+                os << "    " << std::left << std::setw(14) << "IPC" << std::right << ipc << "\n";
+            }
+        }
+        print_histogram(os);
+        os << "\n";
+    }
+
+private:
+    // The samples as one contiguous array of nanoseconds.
+    const double* raw_samples() const {
+        static_assert(sizeof(std::chrono::duration<double, std::nano>) == sizeof(double),
+                      "durations must be laid out as plain doubles");
+        return reinterpret_cast<const double*>(durations.data());
+    }
+
+    // Ranks read by ranked_quantile(q) on n samples.
+    static void add_quantile_ranks(std::vector<size_t>& ranks, size_t n, double q) {
+        const double pos = std::min(std::max(q, 0.0), 1.0) * static_cast<double>(n - 1);
+        const size_t lo = static_cast<size_t>(pos);
+        ranks.push_back(lo);
+        ranks.push_back(std::min(lo + 1, n - 1));
+    }
+
+    // Puts the listed ranks of `values` in place (see detail::select_ranks).
+    static void select_ranks(std::vector<double>& values, std::vector<size_t>& ranks) {
+        std::sort(ranks.begin(), ranks.end());
+        ranks.erase(std::unique(ranks.begin(), ranks.end()), ranks.end());
+        detail::select_ranks(values.data(), values.data() + values.size(), ranks.data(), ranks.data() + ranks.size());
+    }
+
+    // Linearly interpolated quantile (q in 0..1) of a sample set that is
+    // sorted or has the ranks from add_quantile_ranks(q) selected.
+    static double ranked_quantile(const std::vector<double>& ranked, double q) {
+        const double pos = std::min(std::max(q, 0.0), 1.0) * static_cast<double>(ranked.size() - 1);
+        const size_t lo = static_cast<size_t>(pos);
+        const size_t hi = std::min(lo + 1, ranked.size() - 1);
+        return ranked[lo] + (ranked[hi] - ranked[lo]) * (pos - static_cast<double>(lo));
+    }
+
+    // Outlier counts and outlier-resistant location estimates of one run.
+    struct TailSummary {
+        OutlierCounts outliers;
+        double trimmed_mean_ns = 0.0;
+        double inlier_mean_ns = 0.0;
+        double inlier_variance_ns = 0.0;
+    };
+
+    // Classifies samples against Tukey's fences and computes the trimmed
+    // and inlier location estimates. `for_each` visits (value, weight) pairs
+    // in ascending order: histogram buckets, or raw samples with weight 1.
+    // Raw samples only need to be partitioned at the trim boundaries, since
+    // every sample between two boundaries gets the same trimming weight.
+    // The IQR is floored at one clock tick per call so that a quantized,
+    // nearly constant distribution does not turn every off-by-one-tick
+    // sample into an outlier.
+    template<typename ForEach>
+    TailSummary summarize_tails(ForEach&& for_each, double n, double q1, double q3) const {
+        const double tick_ns = ((cycles_per_ns > 0.0) ? 1.0 / cycles_per_ns : 1.0) / static_cast<double>(batch_size);
+        const double iqr = std::max(q3 - q1, tick_ns);
+        const double low_severe = q1 - 3.0 * iqr;
+        const double low_mild = q1 - 1.5 * iqr;
+        const double high_mild = q3 + 1.5 * iqr;
+        const double high_severe = q3 + 3.0 * iqr;
+        const double trim_low = trim_fraction * n;
+        const double trim_high = n - trim_fraction * n;
+
+        TailSummary summary;
+        double seen = 0.0;
+        double trimmed_sum = 0.0;
+        double trimmed_weight = 0.0;
+        double inlier_weight = 0.0;
+        double inlier_m2 = 0.0;
+        for_each([&](double v, double w) {
+            if (v < low_severe) {
+                summary.outliers.low_severe += static_cast<uint64_t>(w);
+            } else if (v < low_mild) {
+                summary.outliers.low_mild += static_cast<uint64_t>(w);
+            } else if (v > high_severe) {
+                summary.outliers.high_severe += static_cast<uint64_t>(w);
+            } else if (v > high_mild) {
+                summary.outliers.high_mild += static_cast<uint64_t>(w);
+            } else {
+                // Weighted Welford update
+                inlier_weight += w;
+                const double delta = v - summary.inlier_mean_ns;
+                summary.inlier_mean_ns += delta * w / inlier_weight;
+                inlier_m2 += w * delta * (v - summary.inlier_mean_ns);
+            }
+            // Part of this weight that falls inside the untrimmed rank range
+            const double kept = std::max(0.0, std::min(seen + w, trim_high) - std::max(seen, trim_low));
+            trimmed_sum += kept * v;
+            trimmed_weight += kept;
+            seen += w;
+        });
+        summary.trimmed_mean_ns = (trimmed_weight > 0.0) ? trimmed_sum / trimmed_weight : 0.0;
+        summary.inlier_variance_ns = (inlier_weight > 1.0) ? inlier_m2 / (inlier_weight - 1.0) : 0.0;
+        return summary;
+    }
+
+    // Median absolute deviation approximated from histogram bucket midpoints.
+    static double histogram_mad(const LatencyHistogram& h, double median_ns) {
+        std::vector<std::pair<double, uint64_t>> deviations;
+        for (size_t i = 0; i < h.bucket_count(); ++i) {
+            if (h.bucket(i) > 0) {
+                const double mid = 0.5 * (LatencyHistogram::bucket_lower(i) + LatencyHistogram::bucket_upper(i));
+                deviations.emplace_back(std::abs(mid - median_ns), h.bucket(i));
+            }
+        }
+        std::sort(deviations.begin(), deviations.end());
+        const uint64_t half = (h.total() + 1) / 2;
+        uint64_t seen = 0;
+        for (const auto& d : deviations) {
+            seen += d.second;
+            if (seen >= half) {
+                return d.first;
+            }
+        }
+        return 0.0;
+    }
+
+    // Groups samples into power-of-two nanosecond buckets; everything below
+    // 1 ns shares the first bucket.
+    void build_histogram(double divisor) {
+        histogram.clear();
+        std::vector<uint64_t> counts(detail::kLog2BinCount, 0);
+        if (!durations.empty()) {
+            detail::log2_bin_counts(raw_samples(), durations.size(), counts.data());
+        } else {
+            for (size_t i = 0; i < online.histogram.bucket_count(); ++i) {
+                if (online.histogram.bucket(i) > 0) {
+                    counts[detail::log2_bin(LatencyHistogram::bucket_lower(i))] += online.histogram.bucket(i);
+                }
+            }
+        }
+        while (!counts.empty() && counts.back() == 0) {
+            counts.pop_back();
+        }
+        size_t first = 0;
+        while (first < counts.size() && counts[first] == 0) {
+            ++first;
+        }
+        for (size_t bin = first; bin < counts.size(); ++bin) {
+            const double lower_ns = (bin == 0) ? 0.0 : std::ldexp(1.0, static_cast<int>(bin) - 1);
+            const double upper_ns = std::ldexp(1.0, static_cast<int>(bin));
+            histogram.push_back(HistogramBin{lower_ns / divisor, upper_ns / divisor, counts[bin]});
+        }
+    }
+
+    // One-line summary of the recorded environment.
+    void print_environment(std::ostream& os) const {
+        const std::streamsize precision = os.precision();
+        os << "  Env:      " << environment.logical_cpus << " cpus";
+        if (!environment.governor.empty()) {
+            os << ", governor " << environment.governor;
+        }
+        if (environment.turbo >= 0) {
+            os << ", turbo " << (environment.turbo ? "on" : "off");
+        }
+        if (environment.load_average >= 0.0) {
+            os << ", load " << std::setprecision(2) << environment.load_average;
+        }
+        if (environment.pinned_cpu >= 0) {
+            os << ", pinned to cpu " << environment.pinned_cpu;
+        }
+        if (environment.high_priority) {
+            os << ", high priority";
+        }
+        os << "\n" << std::setprecision(static_cast<int>(precision));
+    }
+
+    // Prints the histogram as horizontal bars scaled to the fullest bucket.
+    void print_histogram(std::ostream& os) const {
+        uint64_t peak = 0;
+        for (const auto& bin : histogram) {
+            peak = std::max(peak, bin.count);
+        }
+        if (peak == 0) {
+            return;
+        }
+        os << "  Histogram (" << time_unit_to_string() << "):\n";
+        for (const auto& bin : histogram) {
+            const size_t width = static_cast<size_t>(40.0 * static_cast<double>(bin.count) / static_cast<double>(peak));
+            os << "    [" << std::setw(12) << bin.lower << ", " << std::setw(12) << bin.upper << ") "
+               << std::string(width, '#') << " " << bin.count << "\n";
+        }
+    }
+
+    // Helper to convert TimeUnit to string for output
+    std::string time_unit_to_string() const {
+        switch (time_unit) {
+            case TimeUnit::Nanoseconds: return "ns";
+            case TimeUnit::Microseconds: return "µs";
+            case TimeUnit::Milliseconds: return "ms";
+            case TimeUnit::Seconds: return "s";
+            default: return "unknown";
+        }
+    }
+};
+
+// Independent runs of one benchmark and the spread of their means. A high
+// coefficient of variation means the result does not reproduce from run
+// to run even if each run looks tight on its own.
+struct RepetitionResult {
+    static constexpr double kNoisyCv = 0.05;  // CV above which print() flags the result
+
+    std::string name;
+    TimeUnit time_unit = TimeUnit::Nanoseconds;
+    std::vector<BenchmarkResult> runs;
+    double mean = 0.0;    // Mean of the per-run means
+    double median = 0.0;  // Median of the per-run means
+    double stddev = 0.0;  // Sample standard deviation of the per-run means
+    double cv = 0.0;      // stddev / mean
+
+    bool reproducible(double max_cv = kNoisyCv) const { return cv <= max_cv; }
+
+    void print(std::ostream& os = std::cout) const {
+        const std::streamsize precision = os.precision();
+        const char* unit = (time_unit == TimeUnit::Nanoseconds) ? "ns" :
+                           (time_unit == TimeUnit::Microseconds) ? "µs" :
+                           (time_unit == TimeUnit::Milliseconds) ? "ms" : "s";
+        os << "Repetitions: " << name << " (" << runs.size() << " runs)\n" << std::fixed << std::setprecision(2);
+        os << "  Mean:     " << mean << " " << unit << "\n";
+        os << "  Median:   " << median << " " << unit << "\n";
+        os << "  StdDev:   " << stddev << " " << unit << "\n";
+        os << "  CV:       " << cv * 100.0 << " %" << (reproducible() ? "" : " (not reproducible)") << "\n\n";
+        os << std::setprecision(static_cast<int>(precision));
+    }
+};
+
+// Summarizes repeated runs of the same benchmark (all in one time unit).
+inline RepetitionResult aggregate_repetitions(std::vector<BenchmarkResult> runs) {
+    RepetitionResult result;
+    if (runs.empty()) {
+        return result;
+    }
+    result.name = runs.front().name;
+    result.time_unit = runs.front().time_unit;
+    std::vector<double> means;
+    means.reserve(runs.size());
+    for (const auto& r : runs) {
+        means.push_back(r.mean_time);
+    }
+    const double n = static_cast<double>(means.size());
+    result.mean = std::accumulate(means.begin(), means.end(), 0.0) / n;
+    double sq = 0.0;
+    for (const double m : means) {
+        sq += (m - result.mean) * (m - result.mean);
+    }
+    result.stddev = (means.size() > 1) ? std::sqrt(sq / (n - 1.0)) : 0.0;
+    result.cv = (result.mean > 0.0) ? result.stddev / result.mean : 0.0;
+    std::sort(means.begin(), means.end());
+    const size_t mid = means.size() / 2;
+    result.median = (means.size() % 2 == 0) ? (means[mid - 1] + means[mid]) / 2.0 : means[mid];
+    result.runs = std::move(runs);
+    return result;
+}
+
+// Latency-vs-throughput curve from Benchmark::run_load_sweep(): one
+// open-loop result per offered rate, in increasing order.
+struct LoadSweep {
+    static constexpr double kSustainedFraction = 0.95;  // Achieved/offered rate that counts as keeping up
+
+    std::string name;
+    std::vector<BenchmarkResult> points;
+    double saturation_ops_per_sec = 0.0;  // Highest offered rate that was sustained (0 = none)
+
+    // True if the point's achieved rate kept up with its offered rate.
+    static bool sustained(const BenchmarkResult& point) {
+        return point.aggregate_ops_per_sec >= kSustainedFraction * point.offered_ops_per_sec;
+    }
+
+    void print(std::ostream& os = std::cout) const {
+        const std::streamsize precision = os.precision();
+        os << "Load sweep: " << name << " (saturation ";
+        if (saturation_ops_per_sec > 0.0) {
+            os << std::fixed << std::setprecision(0) << saturation_ops_per_sec << " ops/sec)\n";
+        } else {
+            os << "below the lowest offered rate)\n";
+        }
+        const char* unit = points.empty() ? "ns" :
+                           (points.front().time_unit == TimeUnit::Nanoseconds) ? "ns" :
+                           (points.front().time_unit == TimeUnit::Microseconds) ? "µs" :
+                           (points.front().time_unit == TimeUnit::Milliseconds) ? "ms" : "s";
+        os << "  Latency from the intended start, in " << unit << "\n";
+        os << "  " << std::setw(14) << "offered/s" << std::setw(14) << "achieved/s" << std::setw(12) << "p50"
+           << std::setw(12) << "p99" << std::setw(12) << "p99.9" << "\n";
+        for (const auto& p : points) {
+            os << "  " << std::fixed << std::setprecision(0) << std::setw(14) << p.offered_ops_per_sec << std::setw(14)
+               << p.aggregate_ops_per_sec << std::setprecision(2) << std::setw(12) << p.median_time << std::setw(12)
+               << p.percentile(99.0) << std::setw(12) << p.percentile(99.9) << (sustained(p) ? "" : "  saturated") << "\n";
+        }
+        os << "\n" << std::defaultfloat << std::setprecision(static_cast<int>(precision));
+    }
+};
+
+// Per-sample context for benchmarks that need untimed work around each
+// iteration, e.g. restoring an input that the measured code consumes:
+//
+//   Benchmark().run([](PerfLite::State& state) {
+//       std::vector<int> data;
+//       for (auto _ : state) {
+//           state.pause_timing();
+//           data = make_unsorted_input();
+//           state.resume_timing();
+//           std::sort(data.begin(), data.end());
+//       }
+//   });
+//
+// Only the time outside pause_timing()/resume_timing() is recorded. Each
+// pause/resume pair costs two clock reads, which is a few nanoseconds with
+// ClockSource::CycleCounter.
+class State {
+public:
+    // Loop variable type; marked unused so that compilers do not warn about
+    // the `_` in `for (auto _ : state)`.
+#if defined(__GNUC__)
+    struct __attribute__((unused)) Value {};
+#else
+    struct Value {};
+#endif
+
+    // Range-for iterator; the count lives in the iterator so that the loop
+    // condition does not touch the State.
+    class Iterator {
+    public:
+        Iterator(State* state, uint64_t remaining) : state_(state), remaining_(remaining) {}
+        Value operator*() const { return Value(); }
+        Iterator& operator++() {
+            --remaining_;
+            return *this;
+        }
+        bool operator!=(const Iterator&) {
+            if (remaining_ != 0) {
+                return true;
+            }
+            state_->pause_timing();
+            return false;
+        }
+
+    private:
+        State* state_;
+        uint64_t remaining_;
+    };
+
+    State(uint64_t iterations, ClockSource clock, bool track_allocations = false)
+        : iterations_(iterations), clock_(clock),
+          ns_per_tick_(clock == ClockSource::CycleCounter ? CycleClock::ns_per_tick() : ChronoClock::ns_per_tick()),
+          track_allocations_(track_allocations) {}
+
+    // Starts the timer; the loop stops it after the last iteration.
+    Iterator begin() {
+        resume_timing();
+        return Iterator(this, iterations_);
+    }
+    Iterator end() { return Iterator(this, 0); }
+
+    // Excludes the following work from the sample until resume_timing().
+    // Allocations made while paused are not counted either.
+    void pause_timing() {
+        if (running_) {
+            elapsed_ticks_ += read_stop() - start_ticks_;
+            running_ = false;
+            if (track_allocations_) {
+                AllocationCounters::enabled.store(false, std::memory_order_relaxed);
+            }
+        }
+    }
+
+    void resume_timing() {
+        if (!running_) {
+            if (track_allocations_) {
+                AllocationCounters::enabled.store(true, std::memory_order_relaxed);
+            }
+            running_ = true;
+            start_ticks_ = read_start();
+        }
+    }
+
+    // Number of iterations the loop will run for this sample.
+    uint64_t iterations() const { return iterations_; }
+
+    // Timed portion of the loop in nanoseconds.
+    double elapsed_ns() const { return static_cast<double>(elapsed_ticks_) * ns_per_tick_; }
+
+    // Work done by this sample's loop, for throughput reporting. These
+    // override the Benchmark's bytes_per_iteration()/items_per_iteration().
+    void set_bytes_processed(uint64_t bytes) { bytes_processed_ = bytes; }
+    void set_items_processed(uint64_t items) { items_processed_ = items; }
+    uint64_t bytes_processed() const { return bytes_processed_; }
+    uint64_t items_processed() const { return items_processed_; }
+
+private:
+    uint64_t read_start() const {
+        return (clock_ == ClockSource::CycleCounter) ? CycleClock::start() : ChronoClock::start();
+    }
+    uint64_t read_stop() const {
+        return (clock_ == ClockSource::CycleCounter) ? CycleClock::stop() : ChronoClock::stop();
+    }
+
+    uint64_t iterations_;
+    ClockSource clock_;
+    double ns_per_tick_;
+    bool track_allocations_;
+    uint64_t start_ticks_ = 0;
+    uint64_t elapsed_ticks_ = 0;
+    bool running_ = false;
+    uint64_t bytes_processed_ = 0;
+    uint64_t items_processed_ = 0;
+};
+
+// Wraps a function known at compile time as an empty callable, so that the
+// timed loop calls it directly instead of through a function pointer:
+//
+//   Benchmark().run(PerfLite::fn<&parse_header>, input);
+template<auto F>
+struct FunctionConstant {
+    template<typename... Args>
+    decltype(auto) operator()(Args&&... args) const {
+        return std::invoke(F, std::forward<Args>(args)...);
+    }
+};
+
+template<auto F>
+inline constexpr FunctionConstant<F> fn{};
+
+namespace detail {
+
+// A callable and its arguments bound by reference for the timed loop. It
+// holds only references (no copies, no std::function, no heap), so the
+// call std::invoke makes is fully visible to the compiler. Arguments are
+// passed as lvalues because the same objects are reused by every call.
+template<typename Func, typename... Args>
+struct BoundCall {
+    Func& func;
+    std::tuple<Args&...> args;
+
+    decltype(auto) operator()() const {
+        return std::apply([this](Args&... a) -> decltype(auto) { return std::invoke(func, a...); }, args);
+    }
+};
+
+template<typename Func, typename... Args>
+BoundCall<Func, Args...> bind_call(Func& func, Args&... args) {
+    return BoundCall<Func, Args...>{func, std::tuple<Args&...>(args...)};
+}
+
+} // namespace detail
+
+namespace detail {
+
+// Monotonic time in nanoseconds, comparable across threads.
+inline double steady_now_ns() {
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Bookkeeping of one asynchronous measurement: submit time and latency of
+// every operation, indexed by its slot, plus the completion count the
+// driver waits on. Sized before the operations start.
+struct AsyncState {
+    std::vector<double> submit_ns;
+    std::vector<double> latency_ns;
+    std::atomic<uint64_t> completed{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;  // First failure; read once every operation completed
+
+    explicit AsyncState(uint64_t ops) : submit_ns(ops, 0.0), latency_ns(ops, 0.0) {}
+
+    void complete(size_t slot) {
+        latency_ns[slot] = steady_now_ns() - submit_ns[slot];
+        completed.fetch_add(1, std::memory_order_release);
+    }
+
+    void fail(size_t slot, std::exception_ptr e) {
+        bool expected = false;
+        if (failed.compare_exchange_strong(expected, true)) {
+            error = std::move(e);
+        }
+        complete(slot);
+    }
+};
+
+// Default wait step of the asynchronous driver.
+struct YieldPoll {
+    void operator()() const { std::this_thread::yield(); }
+};
+
+// Anything with wait_for() and get(), such as std::future and std::shared_future.
+template<typename T, typename = void>
+struct is_future_like : std::false_type {};
+template<typename T>
+struct is_future_like<T, std::void_t<decltype(std::declval<T&>().wait_for(std::chrono::seconds(0)) == std::future_status::ready),
+                                     decltype(std::declval<T&>().get())>> : std::true_type {};
+
+} // namespace detail
+
+// Handle passed to callback-style asynchronous benchmarks (see
+// Benchmark::run_async()). Invoke it exactly once, from any thread, when the
+// operation has completed, or report a failure with fail().
+class Completion {
+public:
+    Completion(detail::AsyncState& state, size_t slot) : state_(&state), slot_(slot) {}
+
+    void operator()() const { state_->complete(slot_); }
+    void fail(std::exception_ptr error) const { state_->fail(slot_, std::move(error)); }
+
+private:
+    detail::AsyncState* state_;
+    size_t slot_;
+};
+
+#if defined(PERFLITE_HAS_COROUTINES)
+namespace detail {
+
+template<typename T, typename = void>
+struct has_await_ready : std::false_type {};
+template<typename T>
+struct has_await_ready<T, std::void_t<decltype(std::declval<T&>().await_ready())>> : std::true_type {};
+template<typename T, typename = void>
+struct has_member_co_await : std::false_type {};
+template<typename T>
+struct has_member_co_await<T, std::void_t<decltype(std::declval<T>().operator co_await())>> : std::true_type {};
+
+// Awaiters and awaitables with a member operator co_await.
+template<typename T>
+inline constexpr bool is_awaitable_v = has_await_ready<T>::value || has_member_co_await<T>::value;
+
+// Eagerly started, self-destroying coroutine that awaits one operation.
+struct DetachedCoroutine {
+    struct promise_type {
+        DetachedCoroutine get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+
+template<typename Awaitable>
+DetachedCoroutine await_then_complete(Awaitable awaitable, Completion done) {
+    try {
+        co_await std::move(awaitable);
+    } catch (...) {
+        done.fail(std::current_exception());
+        co_return;
+    }
+    done();
+}
+
+} // namespace detail
+#endif
+
+// Benchmark runner class for configuring and executing benchmarks.
+class Benchmark {
+private:
+    size_t warmup_iterations_;
+    size_t iterations_;
+    std::chrono::milliseconds target_duration_;
+    TimeUnit time_unit_;
+    std::string name_;
+    bool batched_;
+    size_t batch_size_;
+    bool subtract_overhead_;
+    ClockSource clock_;
+    bool streaming_;
+    std::vector<double> percentile_levels_;
+    bool hardware_counters_;
+    size_t threads_;
+    int pin_cpu_;
+    bool high_priority_;
+    bool check_environment_;
+    double bytes_per_iteration_;
+    double items_per_iteration_;
+    CacheMode cache_mode_;
+    const void* flush_data_;
+    size_t flush_bytes_;
+    size_t repetitions_;
+    double trim_fraction_;
+    double confidence_target_;
+    StopStatistic stop_statistic_;
+    std::chrono::milliseconds max_time_;
+    size_t range_start_;
+    size_t range_end_;
+    size_t range_multiplier_;
+    bool track_allocations_;
+    bool expect_no_allocations_;
+    bool huge_pages_;
+    size_t queue_depth_;
+    double offered_load_;
+    Arrivals arrivals_;
+    bool record_timestamps_;
+    bool track_memory_;
+
+    // Minimum wall time of one timed block in batched mode.
+    static constexpr double kMinBatchDurationNs = 1000.0;
+
+    // Invokes the function once, keeping its effects observable.
+    template<typename Func>
+    static void invoke_once(Func& func) {
+        if constexpr (std::is_same_v<std::invoke_result_t<Func&>, void>) {
+            func();
+            std::atomic_thread_fence(std::memory_order_seq_cst); // Memory barrier for void functions
+        } else {
+            // Bind by reference: returning a reference must not add a copy
+            auto&& func_result = func();
+            DoNotOptimize(func_result);
+        }
+    }
+
+    // Sample sinks for measure_samples(): keep every sample (in a vector or
+    // a pre-sized arena) or fold it into the streaming accumulator.
+    static void record_sample(std::vector<std::chrono::duration<double, std::nano>>& out, double ns) {
+        out.push_back(std::chrono::duration<double, std::nano>(ns));
+    }
+    static void record_sample(detail::SampleArena& out, double ns) {
+        out.push(ns);
+    }
+    static void record_sample(OnlineStatistics& out, double ns) {
+        out.add(ns);
+    }
+
+    // Arena sink that also keeps the start tick of every block, for
+    // record_timestamps(). Starts are reserved with the samples, so pushing
+    // one never allocates.
+    struct TimestampedArena {
+        detail::SampleArena& samples;
+        std::vector<uint64_t>& starts;
+    };
+    static void record_sample(TimestampedArena& out, double ns) {
+        out.samples.push(ns);
+    }
+
+    // Timed loop shared by run() and the overhead calibration: records
+    // `samples` per-call averages over blocks of `batch` calls. With an
+    // evictor, the caches are evicted before each block, outside the timing.
+    template<typename Clock, typename Func, typename Sink>
+    static void measure_samples(Func& func, uint64_t samples, uint64_t batch, Sink& out,
+                                const detail::CacheEvictor* evictor = nullptr) {
+        const double ns_per_call_tick = Clock::ns_per_tick() / static_cast<double>(batch);
+        for (uint64_t i = 0; i < samples; ++i) {
+            if (evictor) {
+                evictor->evict();
+            }
+            const uint64_t iter_start = Clock::start();
+            for (uint64_t j = 0; j < batch; ++j) {
+                invoke_once(func);
+            }
+            const uint64_t iter_end = Clock::stop();
+            if constexpr (std::is_same_v<Sink, TimestampedArena>) {
+                out.starts.push_back(iter_start);
+            }
+            record_sample(out, static_cast<double>(iter_end - iter_start) * ns_per_call_tick);
+        }
+    }
+
+    static constexpr uint64_t kMinAdaptiveSamples = 30;
+    static constexpr double kConfidenceZ = 1.959963984540054;  // Two-sided 95%
+
+    // Relative CI half-width of the stop statistic over all samples so far.
+    // `moments` accumulates the samples not yet seen by a previous call;
+    // `tick_ns` (one clock tick per call) bounds the median's precision.
+    double relative_half_width(const detail::SampleArena& samples, OnlineStatistics& moments, double tick_ns) const {
+        if (stop_statistic_ == StopStatistic::Mean) {
+            for (size_t i = static_cast<size_t>(moments.count); i < samples.size(); ++i) {
+                moments.add(samples[i]);
+            }
+            return online_half_width(moments);
+        }
+        // Distribution-free interval from the order statistics around n/2
+        const double n = static_cast<double>(samples.size());
+        const double spread = kConfidenceZ * std::sqrt(n) / 2.0;
+        const size_t lo = static_cast<size_t>(std::max(0.0, std::floor(n / 2.0 - spread)));
+        const size_t hi = static_cast<size_t>(std::min(n - 1.0, std::ceil(n / 2.0 + spread)));
+        std::vector<double> sorted(samples.begin(), samples.end());
+        std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(hi), sorted.end());
+        const double upper = sorted[hi];
+        std::nth_element(sorted.begin(), sorted.begin() + static_cast<std::ptrdiff_t>(lo), sorted.begin() + static_cast<std::ptrdiff_t>(hi));
+        const double lower = sorted[lo];
+        std::nth_element(sorted.begin() + static_cast<std::ptrdiff_t>(lo), sorted.begin() + static_cast<std::ptrdiff_t>(samples.size() / 2),
+                         sorted.begin() + static_cast<std::ptrdiff_t>(hi));
+        const double median = sorted[samples.size() / 2];
+        return (median > 0.0) ? std::max(upper - lower, tick_ns) / (2.0 * median) : 0.0;
+    }
+
+    double relative_half_width(const TimestampedArena& out, OnlineStatistics& moments, double tick_ns) const {
+        return relative_half_width(out.samples, moments, tick_ns);
+    }
+
+    // Streaming samples: the accumulator itself holds the moments.
+    double relative_half_width(const OnlineStatistics& stats, OnlineStatistics&, double) const {
+        return online_half_width(stats);
+    }
+
+    // Mean from the moments; median from the histogram quantiles, so its
+    // resolution is limited to the histogram bucket width (about 1.6%).
+    double online_half_width(const OnlineStatistics& stats) const {
+        if (stats.count < 2) {
+            return INFINITY;
+        }
+        const double n = static_cast<double>(stats.count);
+        if (stop_statistic_ == StopStatistic::Mean) {
+            const double half = kConfidenceZ * std::sqrt(stats.variance() / n);
+            return (stats.mean > 0.0) ? half / stats.mean : 0.0;
+        }
+        const double spread = kConfidenceZ * std::sqrt(n) / 2.0 / n;
+        const double median = stats.quantile(0.5);
+        const double half = (stats.quantile(std::min(1.0, 0.5 + spread)) - stats.quantile(std::max(0.0, 0.5 - spread))) / 2.0;
+        // Never claim more precision than the bucket holding the median
+        const size_t bucket = LatencyHistogram::index_of(median);
+        const double resolution = (LatencyHistogram::bucket_upper(bucket) - LatencyHistogram::bucket_lower(bucket)) / 2.0;
+        return (median > 0.0) ? std::max(half, resolution) / median : 0.0;
+    }
+
+    // Grows sample storage between chunks of the adaptive loop.
+    void reserve_samples(detail::SampleArena& samples, uint64_t count) const {
+        samples.reserve(static_cast<size_t>(count), huge_pages_);
+    }
+    void reserve_samples(OnlineStatistics&, uint64_t) const {}
+    void reserve_samples(TimestampedArena& out, uint64_t count) const {
+        reserve_samples(out.samples, count);
+        out.starts.reserve(static_cast<size_t>(count));
+    }
+
+    // Adaptive loop: measures chunks of samples (the first of `first_chunk`,
+    // later ones half the samples taken so far) until the confidence target
+    // is met or max_time() elapses. Returns the number of samples taken.
+    template<typename Clock, typename Func, typename Sink>
+    uint64_t measure_until_confident(Func& func, uint64_t first_chunk, uint64_t batch, Sink& out,
+                                     BenchmarkResult& result, const detail::CacheEvictor* evictor) const {
+        const auto deadline = std::chrono::steady_clock::now() + max_time_;
+        first_chunk = std::max(kMinAdaptiveSamples, first_chunk / 10);
+        OnlineStatistics moments;
+        uint64_t taken = 0;
+        uint64_t chunk = first_chunk;
+        // The bookkeeping between chunks is not part of the measured code
+        const bool counting = AllocationCounters::enabled.load(std::memory_order_relaxed);
+        for (;;) {
+            AllocationCounters::enabled.store(false, std::memory_order_relaxed);
+            reserve_samples(out, taken + chunk);
+            AllocationCounters::enabled.store(counting, std::memory_order_relaxed);
+            measure_samples<Clock>(func, chunk, batch, out, evictor);
+            taken += chunk;
+            AllocationCounters::enabled.store(false, std::memory_order_relaxed);
+            result.confidence_half_width = relative_half_width(out, moments, Clock::ns_per_tick() / static_cast<double>(batch));
+            AllocationCounters::enabled.store(counting, std::memory_order_relaxed);
+            if (result.confidence_half_width <= confidence_target_) {
+                result.converged = true;
+                return taken;
+            }
+            if (std::chrono::steady_clock::now() >= deadline) {
+                return taken;
+            }
+            chunk = std::max(first_chunk, taken / 2);
+        }
+    }
+
+    // Cost of the timed loop itself, split into a per-call part (loop body,
+    // fence or DoNotOptimize) and a per-block part (the pair of clock reads).
+    struct HarnessOverhead {
+        double per_call_ns;
+        double per_block_ns;
+
+        // Overhead attributed to each call for a given block size.
+        double for_batch(uint64_t batch) const {
+            return per_call_ns + per_block_ns / static_cast<double>(batch);
+        }
+    };
+
+    // Measures the harness overhead once per process by running an empty
+    // lambda through measure_samples(). Void and value-returning functions
+    // are barriered differently, so each kind (and each clock) gets its own
+    // cached estimate.
+    template<typename Clock, bool ReturnsVoid>
+    static const HarnessOverhead& harness_overhead() {
+        static const HarnessOverhead overhead = [] {
+            auto empty = [] {
+                if constexpr (ReturnsVoid) {
+                    return;
+                } else {
+                    return 0;
+                }
+            };
+            auto median = [](std::vector<std::chrono::duration<double, std::nano>>& v) {
+                std::nth_element(v.begin(), v.begin() + v.size() / 2, v.end());
+                return v[v.size() / 2].count();
+            };
+
+            std::vector<std::chrono::duration<double, std::nano>> samples;
+            samples.reserve(kOverheadSamples);
+            measure_samples<Clock>(empty, kOverheadSamples, 1, samples);
+            const double single_ns = median(samples);
+
+            samples.clear();
+            measure_samples<Clock>(empty, kOverheadSamples, kOverheadBatch, samples);
+            const double per_call_ns = median(samples);
+
+            return HarnessOverhead{per_call_ns, std::max(single_ns - per_call_ns, 0.0)};
+        }();
+        return overhead;
+    }
+
+    static constexpr uint64_t kOverheadSamples = 1000;
+    static constexpr uint64_t kOverheadBatch = 1000;
+
+    // Sample layout chosen by calibrate().
+    struct RunPlan {
+        uint64_t samples;
+        uint64_t batch;
+        double time_per_iteration_ns;  // Estimate from the calibration probe
+    };
+
+    BenchmarkResult make_result() const {
+        BenchmarkResult result(time_unit_);
+        result.name = name_;
+        result.percentile_levels = percentile_levels_;
+        result.threads = threads_;
+        result.warmup_iterations = warmup_iterations_;
+        result.target_duration_ns = std::chrono::duration<double, std::nano>(target_duration_).count();
+        result.streaming = streaming_;
+        result.confidence_target = confidence_target_;
+        result.trim_fraction = trim_fraction_;
+        result.bytes_per_iteration = bytes_per_iteration_;
+        result.items_per_iteration = items_per_iteration_;
+        return result;
+    }
+
+    // Runs the warmup and the calibration probe, then sizes the measurement
+    // to the target duration.
+    template<typename Func>
+    RunPlan calibrate(Func& func) const {
+        // Warmup phase to stabilize performance
+        for (size_t i = 0; i < warmup_iterations_; ++i) {
+            func();
+        }
+
+        // Measure execution time for 1000 iterations to estimate per-iteration time
+        auto measure_start = std::chrono::high_resolution_clock::now();
+        for (size_t i = 0; i < 1000; ++i) {
+            invoke_once(func);
+        }
+        auto measure_end = std::chrono::high_resolution_clock::now();
+        auto total_time = std::chrono::duration_cast<std::chrono::nanoseconds>(measure_end - measure_start);
+
+        const double time_per_iteration_ns = static_cast<double>(total_time.count()) / 1000.0;
+        return plan_for(time_per_iteration_ns, time_per_iteration_ns);
+    }
+
+    static constexpr uint64_t kMinColdSamples = 50;
+
+    // Cold-cache runs time single calls, each preceded by an eviction, so
+    // the sample count comes from the target duration over the cost of
+    // eviction plus call, with a lower floor than warm runs.
+    RunPlan cold_plan(const detail::CacheEvictor& evictor, const RunPlan& warm) const {
+        constexpr int kProbes = 3;
+        const auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < kProbes; ++i) {
+            evictor.evict();
+        }
+        const double evict_ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - start).count() / kProbes;
+        const double per_sample_ns = evict_ns + warm.time_per_iteration_ns;
+        const double target_ns = static_cast<double>(target_duration_.count()) * 1e6;
+        uint64_t samples = (per_sample_ns > 0.0) ? static_cast<uint64_t>(target_ns / per_sample_ns) : kMinColdSamples;
+        samples = std::min<uint64_t>(std::max(samples, kMinColdSamples), 1'000'000);
+        return RunPlan{samples, 1, warm.time_per_iteration_ns};
+    }
+
+    // Sizes the measurement from per-iteration estimates: `wall_ns` is the
+    // full cost of one iteration (used against the target duration) and
+    // `timed_ns` the part that is actually timed (used to size batches).
+    RunPlan plan_for(double wall_ns, double timed_ns) const {
+        uint64_t adjusted_iterations = iterations_;
+
+        if (wall_ns > 0.0) {
+            // 1. Calculate Target Duration in nanoseconds (1 ms = 1,000,000 ns)
+            const uint64_t target_duration_ns = target_duration_.count() * 1'000'000LL;
+
+            // 2. Calculate Adjusted Iterations: Target_ns / Time_Per_Iteration_ns
+            adjusted_iterations = static_cast<uint64_t>(static_cast<double>(target_duration_ns) / wall_ns);
+            
+            // Ensure minimum 1000 iterations and cap at 1,000,000 to prevent overflow/excessive runtime
+            adjusted_iterations = std::max(adjusted_iterations, static_cast<uint64_t>(1000));
+            adjusted_iterations = std::min(adjusted_iterations, static_cast<uint64_t>(1'000'000));
+        }
+
+        // 3. Pick the batch size so that one timed block lasts at least
+        // kMinBatchDurationNs, keeping the clock reads negligible.
+        uint64_t batch = 1;
+        if (batched_) {
+            if (batch_size_ > 0) {
+                batch = batch_size_;
+            } else if (timed_ns > 0.0) {
+                batch = static_cast<uint64_t>(std::ceil(kMinBatchDurationNs / timed_ns));
+            } else {
+                batch = static_cast<uint64_t>(kMinBatchDurationNs);
+            }
+            batch = std::max<uint64_t>(1, std::min(batch, adjusted_iterations));
+        }
+        const uint64_t samples = std::max<uint64_t>(1, adjusted_iterations / batch);
+        return RunPlan{samples, batch, wall_ns};
+    }
+
+    // State-based benchmarks: every sample is one call of func with a State
+    // that loops `batch` times; paused work is excluded from the sample.
+    // Runs on the calling thread only.
+    template<typename Func>
+    void measure_state(Func& func, BenchmarkResult& result) const {
+        if (threads_ > 1) {
+            std::cerr << "Warning: threads() is not supported for State benchmarks; running '"
+                      << name_ << "' on one thread\n";
+        }
+        result.threads = 1;
+
+        // Warmup phase to stabilize performance
+        {
+            State warmup(warmup_iterations_, clock_);
+            func(warmup);
+        }
+
+        // Calibration probe: 1000 iterations, separating wall and timed cost
+        State probe(1000, clock_);
+        const auto probe_start = std::chrono::steady_clock::now();
+        func(probe);
+        const double probe_wall_ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - probe_start).count();
+        const RunPlan plan = plan_for(probe_wall_ns / 1000.0, probe.elapsed_ns() / 1000.0);
+
+        result.batch_size = static_cast<size_t>(plan.batch);
+        result.iterations = static_cast<size_t>(plan.samples * plan.batch);
+        result.clock = (clock_ == ClockSource::CycleCounter && CycleClock::counts_cycles)
+            ? ClockSource::CycleCounter : ClockSource::Chrono;
+        result.cycles_per_ns = (result.clock == ClockSource::CycleCounter) ? 1.0 / CycleClock::ns_per_tick() : 0.0;
+        detail::SampleArena& arena = detail::SampleArena::for_this_thread();
+        arena.clear();
+        if (streaming_) {
+            result.online.prepare();
+        } else {
+            arena.reserve(static_cast<size_t>(plan.samples), huge_pages_);
+        }
+
+        std::unique_ptr<PerfCounters> counters;
+        if (hardware_counters_) {
+            counters = std::make_unique<PerfCounters>();
+            counters->start();
+        }
+        const auto wall_start = std::chrono::steady_clock::now();
+        detail::MemoryScope memory_scope(track_memory_);
+        detail::AllocationScope allocation_scope(track_allocations_);
+        if (track_allocations_) {
+            // Only the timed sections inside the State loop are counted.
+            AllocationCounters::enabled.store(false, std::memory_order_relaxed);
+        }
+        uint64_t bytes = 0;
+        uint64_t items = 0;
+        for (uint64_t i = 0; i < plan.samples; ++i) {
+            State state(plan.batch, clock_, track_allocations_);
+            func(state);
+            bytes += state.bytes_processed();
+            items += state.items_processed();
+            const double ns = state.elapsed_ns() / static_cast<double>(plan.batch);
+            if (streaming_) {
+                record_sample(result.online, ns);
+            } else {
+                record_sample(arena, ns);
+            }
+        }
+        allocation_scope.stop();
+        memory_scope.stop();
+        if (!streaming_) {
+            arena.append_to(result.durations);
+        }
+        const double wall_ns = std::chrono::duration<double, std::nano>(
+            std::chrono::steady_clock::now() - wall_start).count();
+        const double calls = static_cast<double>(result.iterations);
+        if (bytes > 0) {
+            result.bytes_per_iteration = static_cast<double>(bytes) / calls;
+        }
+        if (items > 0) {
+            result.items_per_iteration = static_cast<double>(items) / calls;
+        }
+        if (counters) {
+            counters->stop();
+            result.counters = counters->read(plan.samples * plan.batch);
+            const double cycles = result.counter("cycles");
+            result.ipc = (cycles > 0.0) ? result.counter("instructions") / cycles : 0.0;
+        }
+        record_allocations(result);
+        record_memory(result, memory_scope);
+        const double throughput = (wall_ns > 0.0) ? static_cast<double>(result.iterations) * 1e9 / wall_ns : 0.0;
+        result.thread_ops_per_sec.assign(1, throughput);
+        result.aggregate_ops_per_sec = throughput;
+        result.scaling_efficiency = 1.0;
+    }
+
+    // Runs the timed loop on `count` pinned threads released together by a
+    // spin barrier, then merges their samples into the result. Each thread
+    // performs the full planned number of iterations.
+    template<typename Clock, typename Func>
+    void measure_threaded(Func& func, const RunPlan& plan, size_t count, BenchmarkResult& result) const {
+        struct Worker {
+            detail::SampleArena samples;
+            OnlineStatistics online;
+            std::vector<CounterValue> counters;
+            double wall_ns = 0.0;
+            std::exception_ptr error;
+        };
+        std::vector<Worker> workers(count);
+        // The calling thread joins the barrier so that it can enable the
+        // allocation counters only once every worker is ready.
+        SpinBarrier barrier(count + 1);
+        std::vector<int> cpus = detail::allowed_cpus();
+        const auto first = std::find(cpus.begin(), cpus.end(), pin_cpu_);
+        if (first != cpus.end()) {
+            std::rotate(cpus.begin(), first, cpus.end());
+        }
+
+        std::vector<std::thread> pool;
+        pool.reserve(count);
+        for (size_t t = 0; t < count; ++t) {
+            pool.emplace_back([&, t] {
+                Worker& w = workers[t];
+                if (!cpus.empty()) {
+                    detail::pin_current_thread(cpus[t % cpus.size()]);
+                }
+                detail::ScopedPriority priority(high_priority_);
+                // A failed setup is recorded rather than thrown, so that this
+                // worker still arrives at the barrier and nobody spins forever.
+                std::unique_ptr<PerfCounters> counters;
+                try {
+                    if (streaming_) {
+                        w.online.prepare();
+                    } else {
+                        w.samples.reserve(static_cast<size_t>(plan.samples), huge_pages_);
+                    }
+                    if (hardware_counters_) {
+                        counters = std::make_unique<PerfCounters>();
+                    }
+                } catch (...) {
+                    w.error = std::current_exception();
+                }
+                barrier.arrive_and_wait();
+                if (w.error) {
+                    return;
+                }
+                try {
+                    if (counters) {
+                        counters->start();
+                    }
+                    const auto wall_start = std::chrono::steady_clock::now();
+                    if (streaming_) {
+                        measure_samples<Clock>(func, plan.samples, plan.batch, w.online);
+                    } else {
+                        measure_samples<Clock>(func, plan.samples, plan.batch, w.samples);
+                    }
+                    w.wall_ns = std::chrono::duration<double, std::nano>(
+                        std::chrono::steady_clock::now() - wall_start).count();
+                    if (counters) {
+                        counters->stop();
+                        w.counters = counters->read(plan.samples * plan.batch);
+                    }
+                } catch (...) {
+                    w.error = std::current_exception();
+                }
+            });
+        }
+        detail::MemoryScope memory_scope(track_memory_);
+        {
+            detail::AllocationScope allocation_scope(track_allocations_);
+            barrier.arrive_and_wait();
+            for (auto& thread : pool) {
+                thread.join();
+            }
+        }
+        memory_scope.stop();
+        for (const auto& w : workers) {
+            if (w.error) {
+                std::rethrow_exception(w.error);
+            }
+        }
+
+        result.clock = Clock::counts_cycles ? ClockSource::CycleCounter : ClockSource::Chrono;
+        result.cycles_per_ns = Clock::counts_cycles ? 1.0 / Clock::ns_per_tick() : 0.0;
+        if (subtract_overhead_) {
+            constexpr bool returns_void = std::is_same_v<std::invoke_result_t<Func&>, void>;
+            result.overhead_ns = harness_overhead<Clock, returns_void>().for_batch(plan.batch);
+            result.subtract_overhead = true;
+        }
+        result.iterations = static_cast<size_t>(plan.samples * plan.batch * count);
+        record_allocations(result);
+        record_memory(result, memory_scope);
+        if (streaming_) {
+            result.online.prepare();
+        } else {
+            result.durations.reserve(static_cast<size_t>(plan.samples * count));
+        }
+        result.thread_ops_per_sec.clear();
+        result.aggregate_ops_per_sec = 0.0;
+        for (const auto& w : workers) {
+            if (streaming_) {
+                result.online.merge(w.online);
+            } else {
+                w.samples.append_to(result.durations);
+            }
+            const double throughput = (w.wall_ns > 0.0)
+                ? static_cast<double>(plan.samples * plan.batch) * 1e9 / w.wall_ns : 0.0;
+            result.thread_ops_per_sec.push_back(throughput);
+            result.aggregate_ops_per_sec += throughput;
+        }
+        // Counters are averaged over threads (every thread runs the same iterations).
+        for (const auto& w : workers) {
+            for (const auto& c : w.counters) {
+                auto it = std::find_if(result.counters.begin(), result.counters.end(),
+                                       [&](const CounterValue& v) { return v.name == c.name; });
+                if (it == result.counters.end()) {
+                    result.counters.push_back(CounterValue{c.name, c.per_iteration / static_cast<double>(count)});
+                } else {
+                    it->per_iteration += c.per_iteration / static_cast<double>(count);
+                }
+            }
+        }
+        const double cycles = result.counter("cycles");
+        result.ipc = (cycles > 0.0) ? result.counter("instructions") / cycles : 0.0;
+    }
+
+    // Copies the allocation counters into the result and enforces
+    // expect_no_allocations().
+    void record_allocations(BenchmarkResult& result) const {
+        if (!track_allocations_) {
+            return;
+        }
+        if (!AllocationCounters::installed.load()) {
+            std::cerr << "Warning: allocation tracking for '" << name_ << "' needs PERFLITE_TRACK_ALLOCATIONS "
+                      << "defined in one translation unit before including perf_lite.h\n";
+            return;
+        }
+        const double calls = static_cast<double>(std::max<size_t>(result.iterations, 1));
+        const uint64_t allocations = AllocationCounters::allocations.load();
+        result.allocations_tracked = true;
+        result.allocations_per_iteration = static_cast<double>(allocations) / calls;
+        result.allocated_bytes_per_iteration = static_cast<double>(AllocationCounters::bytes.load()) / calls;
+        result.peak_live_bytes = static_cast<uint64_t>(std::max<int64_t>(AllocationCounters::peak_live_bytes.load(), 0));
+        if (expect_no_allocations_ && allocations > 0) {
+            throw std::runtime_error("Benchmark '" + name_ + "' expected no allocations but made " +
+                                     std::to_string(allocations) + " in the measured loop");
+        }
+    }
+
+    // Copies the resource deltas of the measured loop into the result.
+    void record_memory(BenchmarkResult& result, const detail::MemoryScope& scope) const {
+        if (!track_memory_) {
+            return;
+        }
+        if (!scope.measured()) {
+            std::cerr << "Warning: memory tracking for '" << name_ << "' is only supported on Linux\n";
+            return;
+        }
+        const double calls = static_cast<double>(std::max<size_t>(result.iterations, 1));
+        const detail::ResourceUsage& start = scope.start();
+        const detail::ResourceUsage& end = scope.end();
+        auto per_call = [calls](uint64_t before, uint64_t after) {
+            return (after > before) ? static_cast<double>(after - before) / calls : 0.0;
+        };
+        result.memory_tracked = true;
+        result.minor_faults_per_iteration = per_call(start.minor_faults, end.minor_faults);
+        result.major_faults_per_iteration = per_call(start.major_faults, end.major_faults);
+        result.voluntary_switches_per_iteration = per_call(start.voluntary_switches, end.voluntary_switches);
+        result.involuntary_switches_per_iteration = per_call(start.involuntary_switches, end.involuntary_switches);
+        result.rss_growth_bytes = static_cast<int64_t>(end.rss_bytes) - static_cast<int64_t>(start.rss_bytes);
+        result.peak_rss_growth_bytes = scope.peak_rss_growth();
+    }
+
+    // Runs the timed loop with the given clock and records the clock-specific
+    // fields (overhead estimate, cycle conversion) in the result.
+    template<typename Clock, typename Func>
+    void measure_with(Func& func, uint64_t samples, uint64_t batch, BenchmarkResult& result,
+                      const detail::CacheEvictor* evictor) const {
+        result.clock = Clock::counts_cycles ? ClockSource::CycleCounter : ClockSource::Chrono;
+        result.cycles_per_ns = Clock::counts_cycles ? 1.0 / Clock::ns_per_tick() : 0.0;
+        if (subtract_overhead_) {
+            constexpr bool returns_void = std::is_same_v<std::invoke_result_t<Func&>, void>;
+            result.overhead_ns = harness_overhead<Clock, returns_void>().for_batch(batch);
+            result.subtract_overhead = true;
+        }
+        std::unique_ptr<PerfCounters> counters;
+        if (hardware_counters_) {
+            counters = std::make_unique<PerfCounters>();
+            counters->start();
+        }
+        detail::SampleArena& arena = detail::SampleArena::for_this_thread();
+        arena.clear();
+        const bool timestamps = record_timestamps_ && !streaming_;
+        if (record_timestamps_ && streaming_) {
+            std::cerr << "Warning: record_timestamps() needs raw samples; ignored in streaming mode for '"
+                      << name_ << "'\n";
+        }
+        std::vector<uint64_t> starts;
+        TimestampedArena timestamped{arena, starts};
+        if (!streaming_ && confidence_target_ <= 0.0) {
+            if (timestamps) {
+                reserve_samples(timestamped, samples);
+            } else {
+                arena.reserve(static_cast<size_t>(samples), huge_pages_);
+            }
+        }
+        auto measure_into = [&](auto& sink) {
+            if (confidence_target_ > 0.0) {
+                samples = measure_until_confident<Clock>(func, samples, batch, sink, result, evictor);
+                result.iterations = static_cast<size_t>(samples * batch);
+            } else {
+                measure_samples<Clock>(func, samples, batch, sink, evictor);
+            }
+        };
+        detail::MemoryScope memory_scope(track_memory_);
+        // Anchors the clock's ticks to the steady clock shared with probes
+        const double anchor_ns = detail::steady_now_ns();
+        const uint64_t anchor_tick = Clock::start();
+        detail::AllocationScope allocation_scope(track_allocations_);
+        if (streaming_) {
+            measure_into(result.online);
+        } else if (timestamps) {
+            measure_into(timestamped);
+        } else {
+            measure_into(arena);
+        }
+        allocation_scope.stop();
+        memory_scope.stop();
+        if (!streaming_) {
+            arena.append_to(result.durations);
+        }
+        if (timestamps) {
+            result.sample_starts_ns.reserve(starts.size());
+            for (const uint64_t tick : starts) {
+                const double offset = static_cast<double>(static_cast<int64_t>(tick - anchor_tick));
+                result.sample_starts_ns.push_back(anchor_ns + offset * Clock::ns_per_tick());
+            }
+        }
+        record_allocations(result);
+        record_memory(result, memory_scope);
+        if (counters) {
+            counters->stop();
+            result.counters = counters->read(samples * batch);
+            const double cycles = result.counter("cycles");
+            result.ipc = (cycles > 0.0) ? result.counter("instructions") / cycles : 0.0;
+        }
+    }
+
+public:
+    // Constructor with default configuration.
+    Benchmark()
+        : warmup_iterations_(10),
+          iterations_(1000),
+          target_duration_(100),
+          time_unit_(TimeUnit::Nanoseconds),
+          name_("Benchmark"),
+          batched_(false),
+          batch_size_(0),
+          subtract_overhead_(false),
+          clock_(ClockSource::Chrono),
+          streaming_(false),
+          percentile_levels_{50.0, 90.0, 99.0, 99.9},
+          hardware_counters_(false),
+          threads_(1),
+          pin_cpu_(-1),
+          high_priority_(false),
+          check_environment_(false),
+          bytes_per_iteration_(0.0),
+          items_per_iteration_(0.0),
+          cache_mode_(CacheMode::Warm),
+          flush_data_(nullptr),
+          flush_bytes_(0),
+          repetitions_(1),
+          trim_fraction_(0.0),
+          confidence_target_(0.0),
+          stop_statistic_(StopStatistic::Mean),
+          max_time_(5000),
+          range_start_(8),
+          range_end_(8 << 10),
+          range_multiplier_(8),
+          track_allocations_(false),
+          expect_no_allocations_(false),
+          huge_pages_(false),
+          queue_depth_(1),
+          offered_load_(0.0),
+          arrivals_(Arrivals::Constant),
+          record_timestamps_(false),
+          track_memory_(false) {}
+
+    // Sets the number of warmup iterations (must be non-zero).
+    Benchmark& warmup(size_t count) {
+        assert(count > 0 && "Warmup iterations must be greater than zero");
+        warmup_iterations_ = count;
+        return *this;
+    }
+
+    // Sets the number of benchmark iterations (must be non-zero).
+    Benchmark& iterations(size_t count) {
+        assert(count > 0 && "Benchmark iterations must be greater than zero");
+        iterations_ = count;
+        return *this;
+    }
+
+    // Sets the target total duration for benchmarking.
+    Benchmark& target_duration(std::chrono::milliseconds duration) {
+        assert(duration.count() > 0 && "Target duration must be greater than zero");
+        target_duration_ = duration;
+        return *this;
+    }
+
+    // Sets the time unit for output.
+    Benchmark& unit(TimeUnit unit) {
+        time_unit_ = unit;
+        return *this;
+    }
+
+    // Sets the benchmark name.
+    Benchmark& name(const std::string& n) {
+        name_ = n;
+        return *this;
+    }
+
+    // Enables batched timing: each sample times a block of calls and records
+    // the per-call average. The batch size is picked by the calibration probe
+    // unless set explicitly with batch_size().
+    Benchmark& batched(bool enable = true) {
+        batched_ = enable;
+        return *this;
+    }
+
+    // Sets a fixed number of calls per timed batch (must be non-zero).
+    // Implies batched timing.
+    Benchmark& batch_size(size_t count) {
+        assert(count > 0 && "Batch size must be greater than zero");
+        batched_ = true;
+        batch_size_ = count;
+        return *this;
+    }
+
+    // Subtracts the harness's own per-call overhead (clock reads, loop body,
+    // barriers) from every location statistic: min, max, mean, median, the
+    // percentiles and the trimmed and inlier means, each clamped at zero.
+    // stddev and MAD are left alone since a constant shift does not change the
+    // spread. The overhead is measured once per process and reported alongside
+    // the result. Ignored, with a warning, for State benchmarks.
+    Benchmark& subtract_overhead(bool enable = true) {
+        subtract_overhead_ = enable;
+        return *this;
+    }
+
+    // Selects the clock backend for the timed loop. CycleCounter reads the
+    // CPU's cycle counter and additionally reports cycles in the result.
+    Benchmark& clock(ClockSource source) {
+        clock_ = source;
+        return *this;
+    }
+
+    // Enables streaming statistics: samples are folded into an O(1)-memory
+    // accumulator (Welford moments, min/max, histogram) instead of being stored
+    // in BenchmarkResult::durations.
+    Benchmark& streaming(bool enable = true) {
+        streaming_ = enable;
+        return *this;
+    }
+
+    // Sets the percentiles (in percent, 0 < level <= 100) reported in the result.
+    Benchmark& percentiles(std::vector<double> levels) {
+        for (double level : levels) {
+            assert(level > 0.0 && level <= 100.0 && "Percentile levels must be in (0, 100]");
+            (void)level;
+        }
+        percentile_levels_ = std::move(levels);
+        return *this;
+    }
+
+    // Collects hardware performance counters (cycles, instructions,
+    // cache/branch/LLC/dTLB events) around the measured loop via
+    // perf_event_open. Counts include the harness's own loop and clock reads.
+    // Linux only; elsewhere, or without permission, no counters are reported.
+    Benchmark& hardware_counters(bool enable = true) {
+        hardware_counters_ = enable;
+        return *this;
+    }
+
+    // Runs the function concurrently on `count` threads (must be non-zero).
+    // Threads are pinned to distinct CPUs where supported and released
+    // together by a spin barrier; see BenchmarkResult::thread_ops_per_sec.
+    Benchmark& threads(size_t count) {
+        assert(count > 0 && "Thread count must be greater than zero");
+        threads_ = count;
+        return *this;
+    }
+
+    // Pins the benchmark thread to a CPU for the duration of run() (negative =
+    // no pinning). With threads(), workers are placed starting at this CPU.
+    Benchmark& pin_to_cpu(int cpu) {
+        pin_cpu_ = cpu;
+        return *this;
+    }
+
+    // Sets the number of operations run_async() keeps in flight (must be non-zero).
+    Benchmark& queue_depth(size_t depth) {
+        assert(depth > 0 && "Queue depth must be greater than zero");
+        queue_depth_ = depth;
+        return *this;
+    }
+
+    // Sets the arrival rate and process for run_open_loop() (ops_per_sec > 0).
+    Benchmark& offered_load(double ops_per_sec, Arrivals arrivals = Arrivals::Constant) {
+        assert(ops_per_sec > 0.0 && "Offered load must be positive");
+        offered_load_ = ops_per_sec;
+        arrivals_ = arrivals;
+        return *this;
+    }
+
+    // Backs sample storage with transparent huge pages (Linux), which keeps
+    // TLB misses on the arena out of long runs. Storage is always pre-sized
+    // and pre-faulted before the timed loop.
+    Benchmark& huge_pages(bool enable = true) {
+        huge_pages_ = enable;
+        return *this;
+    }
+
+    // Keeps the start time of every sample (sample_starts_ns in the result)
+    // so that TraceWriter can place samples on a timeline. Applies to
+    // single-threaded run() of plain callables with raw samples.
+    Benchmark& record_timestamps(bool enable = true) {
+        record_timestamps_ = enable;
+        return *this;
+    }
+
+    // Raises the scheduling priority of the benchmark thread during run().
+    Benchmark& high_priority(bool enable = true) {
+        high_priority_ = enable;
+        return *this;
+    }
+
+    // Warns on stderr before the run about frequency scaling, turbo and a
+    // loaded system. The environment is recorded in the result either way.
+    Benchmark& check_environment(bool enable = true) {
+        check_environment_ = enable;
+        return *this;
+    }
+
+    // Adaptive stopping: instead of a fixed sample count, samples in growing
+    // chunks until the 95% confidence half-width of the mean (or median) is
+    // at most `relative` of its value, or max_time() runs out. 0 disables.
+    // Single-threaded plain callables only.
+    Benchmark& confidence_target(double relative, StopStatistic statistic = StopStatistic::Mean) {
+        assert(relative >= 0.0 && "Confidence target must be non-negative");
+        confidence_target_ = relative;
+        stop_statistic_ = statistic;
+        return *this;
+    }
+
+    // Wall-clock budget of the adaptive measurement loop.
+    Benchmark& max_time(std::chrono::milliseconds budget) {
+        assert(budget.count() > 0 && "Max time must be positive");
+        max_time_ = budget;
+        return *this;
+    }
+
+    // Bytes processed by one call; results then report bytes_per_sec.
+    // State benchmarks can call State::set_bytes_processed() instead.
+    Benchmark& bytes_per_iteration(double bytes) {
+        assert(bytes >= 0.0 && "Bytes per iteration must be non-negative");
+        bytes_per_iteration_ = bytes;
+        return *this;
+    }
+
+    // Items (records, messages, ...) processed by one call; results then
+    // report items_per_sec.
+    Benchmark& items_per_iteration(double items) {
+        assert(items >= 0.0 && "Items per iteration must be non-negative");
+        items_per_iteration_ = items;
+        return *this;
+    }
+
+    // Cold measures every call with evicted data caches (the default Warm
+    // keeps the state the warmup left). Eviction happens outside the timed
+    // region; batching is disabled. Single-threaded plain callables only.
+    Benchmark& cache_mode(CacheMode mode) {
+        cache_mode_ = mode;
+        return *this;
+    }
+
+    // Buffer to flush line by line in cold mode, typically the benchmark's
+    // input. Without one, a scratch arena of twice the LLC size is streamed.
+    Benchmark& cache_flush_buffer(const void* data, size_t bytes) {
+        flush_data_ = data;
+        flush_bytes_ = bytes;
+        return *this;
+    }
+
+    // Also reports the mean with `fraction` of the samples cut from each
+    // tail (e.g. 0.05 for a 5% trimmed mean).
+    Benchmark& trimmed_mean(double fraction) {
+        assert(fraction >= 0.0 && fraction < 0.5 && "Trim fraction must be in [0, 0.5)");
+        trim_fraction_ = fraction;
+        return *this;
+    }
+
+    // Number of independent calibrate+measure cycles run by run_repeated()
+    // and by the registry runner.
+    Benchmark& repetitions(size_t count) {
+        assert(count > 0 && "Repetitions must be positive");
+        repetitions_ = count;
+        return *this;
+    }
+
+    size_t repetition_count() const { return repetitions_; }
+
+    // True if the benchmark may share the machine with other benchmarks in
+    // a parallel suite run: one thread, no process-wide allocation or memory
+    // counters and no cache eviction that would disturb its neighbours.
+    bool co_runnable() const {
+        return threads_ == 1 && !track_allocations_ && !track_memory_ && cache_mode_ == CacheMode::Warm;
+    }
+
+    // Sets the input sizes [start, end] for run_range() (0 < start <= end).
+    Benchmark& range(size_t start, size_t end) {
+        assert(start > 0 && start <= end && "Range must satisfy 0 < start <= end");
+        range_start_ = start;
+        range_end_ = end;
+        return *this;
+    }
+
+    // Sets the factor between consecutive range_points() (must be at least 2).
+    Benchmark& multiplier(size_t factor) {
+        assert(factor >= 2 && "Range multiplier must be at least 2");
+        range_multiplier_ = factor;
+        return *this;
+    }
+
+    // Counts heap allocations, allocated bytes and peak live bytes during the
+    // measured loop. Requires PERFLITE_TRACK_ALLOCATIONS in one translation unit.
+    Benchmark& track_allocations(bool enable = true) {
+        track_allocations_ = enable;
+        return *this;
+    }
+
+    // Makes run() throw std::runtime_error if the measured loop allocates.
+    // Implies track_allocations().
+    Benchmark& expect_no_allocations(bool enable = true) {
+        expect_no_allocations_ = enable;
+        track_allocations_ = track_allocations_ || enable;
+        return *this;
+    }
+
+    // Measures page faults, context switches (per iteration) and resident
+    // set growth over the measured loop (Linux). The counters are
+    // process-wide, so other threads of the process are included.
+    Benchmark& track_memory(bool enable = true) {
+        track_memory_ = enable;
+        return *this;
+    }
+
+    // Runs the benchmark with the specified function.
+    // Adjusts iterations to meet the target duration (minimum 100ms by default).
+    // Handles both void and non-void return types, and functions taking a
+    // State& (see State) whose paused work is excluded from the samples.
+    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func> || std::is_invocable_v<Func, State&>>>
+    BenchmarkResult run(Func&& func) const {
+        constexpr bool uses_state = std::is_invocable_v<Func, State&>;
+        const bool threaded = !uses_state && threads_ > 1;
+        BenchmarkResult result = make_result();
+        detail::ScopedAffinity affinity(threaded ? -1 : pin_cpu_);
+        detail::ScopedPriority priority(high_priority_ && !threaded);
+        result.environment = EnvironmentInfo::capture(pin_cpu_);
+        result.environment.pinned_cpu = affinity.pinned() ? pin_cpu_ : -1;
+        result.environment.high_priority = priority.raised();
+        if (check_environment_) {
+            result.environment.warn();
+            if (pin_cpu_ >= 0 && !threaded && !affinity.pinned()) {
+                std::cerr << "Warning: could not pin benchmark '" << name_ << "' to CPU " << pin_cpu_ << "\n";
+            }
+            if (high_priority_ && !threaded && !priority.raised()) {
+                std::cerr << "Warning: could not raise scheduling priority for benchmark '" << name_ << "'\n";
+            }
+        }
+        if (cache_mode_ == CacheMode::Cold && (uses_state || threaded)) {
+            std::cerr << "Warning: cache_mode(Cold) applies to single-threaded plain benchmarks only; '"
+                      << name_ << "' runs with warm caches\n";
+        }
+        if (confidence_target_ > 0.0 && (uses_state || threaded)) {
+            std::cerr << "Warning: confidence_target() applies to single-threaded plain benchmarks only; '"
+                      << name_ << "' uses the fixed sample count\n";
+            result.confidence_target = 0.0;
+        }
+        if (subtract_overhead_ && uses_state) {
+            std::cerr << "Warning: subtract_overhead() applies to plain benchmarks only; '"
+                      << name_ << "' reports uncorrected times\n";
+        }
+        if constexpr (uses_state) {
+            measure_state(func, result);
+            result.calculate_statistics();
+            return result;
+        } else {
+            measure_plain(func, threaded, result);
+            result.calculate_statistics();
+            return result;
+        }
+    }
+
+private:
+    // Plain callables: calibrate, then time on one or several threads.
+    template<typename Func>
+    void measure_plain(Func& func, bool threaded, BenchmarkResult& result) const {
+        const RunPlan plan = calibrate(func);
+        result.batch_size = static_cast<size_t>(plan.batch);
+        result.iterations = static_cast<size_t>(plan.samples * plan.batch);
+
+        if (threaded) {
+            if (clock_ == ClockSource::CycleCounter) {
+                measure_threaded<CycleClock>(func, plan, threads_, result);
+            } else {
+                measure_threaded<ChronoClock>(func, plan, threads_, result);
+            }
+            // Without a measured single-thread run, scale against the
+            // calibration probe's per-call time.
+            if (plan.time_per_iteration_ns > 0.0) {
+                const double single_ops = 1e9 / plan.time_per_iteration_ns;
+                result.scaling_efficiency = result.aggregate_ops_per_sec / (static_cast<double>(threads_) * single_ops);
+            }
+        } else {
+            RunPlan run_plan = plan;
+            std::unique_ptr<detail::CacheEvictor> evictor;
+            if (cache_mode_ == CacheMode::Cold) {
+                evictor = std::make_unique<detail::CacheEvictor>(flush_data_, flush_bytes_);
+                run_plan = cold_plan(*evictor, plan);
+                result.cache_mode = CacheMode::Cold;
+                result.batch_size = 1;
+                result.iterations = static_cast<size_t>(run_plan.samples);
+            }
+            if (streaming_) {
+                result.online.prepare();
+            }
+
+            // Run actual benchmark
+            const auto wall_start = std::chrono::steady_clock::now();
+            if (clock_ == ClockSource::CycleCounter) {
+                measure_with<CycleClock>(func, run_plan.samples, run_plan.batch, result, evictor.get());
+            } else {
+                measure_with<ChronoClock>(func, run_plan.samples, run_plan.batch, result, evictor.get());
+            }
+            const double wall_ns = std::chrono::duration<double, std::nano>(
+                std::chrono::steady_clock::now() - wall_start).count();
+            const double throughput = (wall_ns > 0.0) ? static_cast<double>(result.iterations) * 1e9 / wall_ns : 0.0;
+            result.thread_ops_per_sec.assign(1, throughput);
+            result.aggregate_ops_per_sec = throughput;
+            result.scaling_efficiency = 1.0;
+        }
+    }
+
+public:
+
+    // Runs the function at thread counts 1, 2, 4, ... up to the hardware
+    // concurrency (always included) and returns one result per count, with
+    // scaling_efficiency measured against the single-thread run.
+    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func>>>
+    std::vector<BenchmarkResult> run_scaling(Func&& func) const {
+        const size_t max_threads = std::max<size_t>(1, std::thread::hardware_concurrency());
+        std::vector<size_t> counts;
+        for (size_t n = 1; n < max_threads; n *= 2) {
+            counts.push_back(n);
+        }
+        counts.push_back(max_threads);
+
+        std::vector<BenchmarkResult> results;
+        for (size_t n : counts) {
+            Benchmark config = *this;
+            config.threads(n).name(name_ + "/threads:" + std::to_string(n));
+            results.push_back(config.run(func));
+        }
+        const double single_ops = results.front().aggregate_ops_per_sec;
+        for (auto& r : results) {
+            r.scaling_efficiency = (single_ops > 0.0)
+                ? r.aggregate_ops_per_sec / (static_cast<double>(r.threads) * single_ops) : 0.0;
+        }
+        return results;
+    }
+
+    // Benchmarks an asynchronous operation with queue_depth() operations in
+    // flight. `func` starts one operation and either takes a Completion to
+    // invoke when it is done, returns a future (anything with wait_for() and
+    // get()), or, with C++20 coroutines, returns an awaitable. Samples are
+    // submit-to-complete latencies; aggregate_ops_per_sec is the sustained
+    // completion rate. `poll` runs whenever the driver waits for a completion,
+    // e.g. to reap io_uring completions or step an event loop. A `func` that
+    // throws counts as a failed operation and must not also complete it.
+    template<typename Func, typename Poll = detail::YieldPoll>
+    BenchmarkResult run_async(Func&& func, Poll&& poll = Poll()) const {
+        if (threads_ > 1) {
+            std::cerr << "Warning: run_async() drives '" << name_
+                      << "' from the calling thread; use queue_depth() instead of threads()\n";
+        }
+        BenchmarkResult result = make_result();
+        result.threads = 1;
+        result.queue_depth = queue_depth_;
+        detail::ScopedAffinity affinity(pin_cpu_);
+        detail::ScopedPriority priority(high_priority_);
+        result.environment = EnvironmentInfo::capture(pin_cpu_);
+        result.environment.pinned_cpu = affinity.pinned() ? pin_cpu_ : -1;
+        result.environment.high_priority = priority.raised();
+
+        // 1. Warmup and a 100-operation probe at the requested depth
+        {
+            detail::AsyncState warmup(warmup_iterations_);
+            drive_async(func, poll, warmup);
+        }
+        constexpr uint64_t kProbeOps = 100;
+        detail::AsyncState probe(kProbeOps);
+        const double probe_ns = drive_async(func, poll, probe);
+        const RunPlan plan = plan_for(probe_ns / kProbeOps, probe_ns / kProbeOps);
+        const uint64_t ops = plan.samples * plan.batch;
+
+        // 2. Measurement
+        detail::AsyncState state(ops);
+        detail::MemoryScope memory_scope(track_memory_);
+        detail::AllocationScope allocation_scope(track_allocations_);
+        const double wall_ns = drive_async(func, poll, state);
+        allocation_scope.stop();
+        memory_scope.stop();
+        result.iterations = static_cast<size_t>(ops);
+        record_allocations(result);
+        record_memory(result, memory_scope);
+        if (streaming_) {
+            result.online.prepare();
+            for (const double ns : state.latency_ns) {
+                result.online.add(ns);
+            }
+        } else {
+            result.durations.reserve(state.latency_ns.size());
+            for (const double ns : state.latency_ns) {
+                result.durations.emplace_back(ns);
+            }
+        }
+        const double throughput = (wall_ns > 0.0) ? static_cast<double>(ops) * 1e9 / wall_ns : 0.0;
+        result.thread_ops_per_sec.assign(1, throughput);
+        result.aggregate_ops_per_sec = throughput;
+        result.scaling_efficiency = 1.0;
+        result.calculate_statistics();
+        return result;
+    }
+
+    // Runs run_async() at queue depths 1, 2, 4, ... up to max_depth (always
+    // included) and returns one result per depth, showing where sustained
+    // throughput stops growing and only latency does.
+    template<typename Func, typename Poll = detail::YieldPoll>
+    std::vector<BenchmarkResult> run_queue_depths(Func&& func, size_t max_depth, Poll&& poll = Poll()) const {
+        assert(max_depth > 0 && "Queue depth must be greater than zero");
+        std::vector<size_t> depths;
+        for (size_t d = 1; d < max_depth; d *= 2) {
+            depths.push_back(d);
+        }
+        depths.push_back(max_depth);
+
+        std::vector<BenchmarkResult> results;
+        for (size_t d : depths) {
+            Benchmark config = *this;
+            config.queue_depth(d).name(name_ + "/depth:" + std::to_string(d));
+            results.push_back(config.run_async(func, poll));
+        }
+        return results;
+    }
+
+    // Open-loop load generator: calls `func` on a fixed schedule at
+    // offered_load() ops/sec (evenly spaced or Poisson arrivals) for
+    // target_duration(), and measures every latency from the call's
+    // intended start rather than its actual start. When the function falls
+    // behind, the calls queue up and their waiting time is counted, which
+    // corrects for coordinated omission. Latencies are recorded in the
+    // streaming HDR-style histogram; aggregate_ops_per_sec is the achieved
+    // rate and service_mean_time the mean time from actual start to end.
+    // Stops after max_time() if the schedule falls too far behind.
+    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func>>>
+    BenchmarkResult run_open_loop(Func&& func) const {
+        assert(offered_load_ > 0.0 && "run_open_loop() needs offered_load()");
+        if (threads_ > 1) {
+            std::cerr << "Warning: run_open_loop() issues calls from one thread; threads() is ignored for '"
+                      << name_ << "'\n";
+        }
+        BenchmarkResult result = make_result();
+        result.threads = 1;
+        result.streaming = true;
+        result.offered_ops_per_sec = offered_load_;
+        result.arrivals = arrivals_;
+        detail::ScopedAffinity affinity(pin_cpu_);
+        detail::ScopedPriority priority(high_priority_);
+        result.environment = EnvironmentInfo::capture(pin_cpu_);
+        result.environment.pinned_cpu = affinity.pinned() ? pin_cpu_ : -1;
+        result.environment.high_priority = priority.raised();
+
+        // 1. Warmup, then the schedule: intended start offsets from t0
+        for (size_t i = 0; i < warmup_iterations_; ++i) {
+            invoke_once(func);
+        }
+        constexpr uint64_t kMinOpenLoopOps = 100;
+        const double interval_ns = 1e9 / offered_load_;
+        const double target_ns = std::chrono::duration<double, std::nano>(target_duration_).count();
+        const uint64_t ops = std::max<uint64_t>(kMinOpenLoopOps, static_cast<uint64_t>(target_ns / interval_ns));
+        std::vector<double> schedule(ops);
+        std::mt19937_64 rng(0x5eed);  // Fixed seed: the same arrivals on every run
+        std::exponential_distribution<double> gap(1.0 / interval_ns);
+        double at = 0.0;
+        for (auto& t : schedule) {
+            t = at;
+            at += (arrivals_ == Arrivals::Poisson) ? gap(rng) : interval_ns;
+        }
+
+        // 2. Issue the calls on schedule
+        using clock = std::chrono::steady_clock;
+        auto since = [](clock::time_point from) {
+            return std::chrono::duration<double, std::nano>(clock::now() - from).count();
+        };
+        const double budget_ns = std::chrono::duration<double, std::nano>(max_time_).count();
+        result.online.prepare();
+        double service_sum_ns = 0.0;
+        uint64_t issued = 0;
+        detail::MemoryScope memory_scope(track_memory_);
+        detail::AllocationScope allocation_scope(track_allocations_);
+        const clock::time_point t0 = clock::now();
+        for (; issued < ops; ++issued) {
+            const double intended = schedule[issued];
+            double start = since(t0);
+            while (start < intended) {
+                start = since(t0);
+            }
+            if (start > budget_ns) {
+                break;
+            }
+            invoke_once(func);
+            const double end = since(t0);
+            result.online.add(end - intended);
+            service_sum_ns += end - start;
+        }
+        const double wall_ns = since(t0);
+        allocation_scope.stop();
+        memory_scope.stop();
+        if (issued < ops) {
+            std::cerr << "Warning: '" << name_ << "' fell behind the offered load; stopped after "
+                      << issued << " of " << ops << " calls (max_time)\n";
+        }
+
+        result.iterations = static_cast<size_t>(issued);
+        record_allocations(result);
+        record_memory(result, memory_scope);
+        const double throughput = (wall_ns > 0.0) ? static_cast<double>(issued) * 1e9 / wall_ns : 0.0;
+        result.thread_ops_per_sec.assign(1, throughput);
+        result.aggregate_ops_per_sec = throughput;
+        result.scaling_efficiency = 1.0;
+        result.calculate_statistics();
+        result.service_mean_time = (issued > 0)
+            ? to_unit(std::chrono::duration<double, std::nano>(service_sum_ns / static_cast<double>(issued)), time_unit_)
+            : 0.0;
+        return result;
+    }
+
+    // Runs run_open_loop() at increasing offered rates and reports the
+    // highest rate the function sustained. Without explicit rates, the
+    // sweep spans 10% to 120% of the closed-loop capacity measured by run().
+    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func>>>
+    LoadSweep run_load_sweep(Func&& func, std::vector<double> rates = {}) const {
+        if (rates.empty()) {
+            Benchmark probe = *this;
+            const BenchmarkResult closed = probe.name(name_ + "/closed_loop").run(func);
+            const double capacity = closed.ops_per_sec;
+            for (const double fraction : {0.1, 0.25, 0.5, 0.75, 0.9, 1.0, 1.2}) {
+                rates.push_back(fraction * capacity);
+            }
+        }
+        std::sort(rates.begin(), rates.end());
+
+        LoadSweep sweep;
+        sweep.name = name_;
+        for (const double rate : rates) {
+            std::ostringstream label;
+            label << name_ << "/rate:" << std::fixed << std::setprecision(0) << rate;
+            Benchmark config = *this;
+            config.offered_load(rate, arrivals_).name(label.str());
+            sweep.points.push_back(config.run_open_loop(func));
+            if (LoadSweep::sustained(sweep.points.back())) {
+                sweep.saturation_ops_per_sec = rate;
+            }
+        }
+        return sweep;
+    }
+
+private:
+    // Keeps up to queue_depth() operations in flight until every slot of
+    // `state` has completed, and returns the wall time. The first failure
+    // stops submission and is rethrown once the operations in flight drain.
+    template<typename Func, typename Poll>
+    double drive_async(Func& func, Poll& poll, detail::AsyncState& state) const {
+        const uint64_t ops = state.submit_ns.size();
+        const size_t depth = queue_depth_;
+        auto drive = [&](auto& submit, auto& wait) {
+            const auto start = std::chrono::steady_clock::now();
+            uint64_t submitted = 0;
+            for (;;) {
+                const uint64_t done = state.completed.load(std::memory_order_acquire);
+                const bool draining = submitted == ops || state.failed.load(std::memory_order_relaxed);
+                if (draining && done == submitted) {
+                    break;
+                }
+                if (!draining && submitted - done < depth) {
+                    state.submit_ns[submitted] = detail::steady_now_ns();
+                    submit(static_cast<size_t>(submitted));
+                    ++submitted;
+                } else {
+                    wait();
+                }
+            }
+            const double wall_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (state.error) {
+                std::rethrow_exception(state.error);
+            }
+            return wall_ns;
+        };
+
+        if constexpr (std::is_invocable_v<Func&, Completion>) {
+            auto submit = [&](size_t slot) {
+                try {
+                    func(Completion(state, slot));
+                } catch (...) {
+                    state.fail(slot, std::current_exception());
+                }
+            };
+            return drive(submit, poll);
+        } else {
+            using Operation = std::invoke_result_t<Func&>;
+            if constexpr (detail::is_future_like<Operation>::value) {
+                std::vector<std::pair<size_t, Operation>> in_flight;
+                in_flight.reserve(depth);
+                auto submit = [&](size_t slot) {
+                    try {
+                        in_flight.emplace_back(slot, func());
+                    } catch (...) {
+                        state.fail(slot, std::current_exception());
+                    }
+                };
+                // Deferred futures only run when get() is called
+                auto reap = [&] {
+                    poll();
+                    for (size_t k = 0; k < in_flight.size();) {
+                        auto& [slot, future] = in_flight[k];
+                        if (future.wait_for(std::chrono::seconds(0)) == std::future_status::timeout) {
+                            ++k;
+                            continue;
+                        }
+                        try {
+                            future.get();
+                            state.complete(slot);
+                        } catch (...) {
+                            state.fail(slot, std::current_exception());
+                        }
+                        in_flight[k] = std::move(in_flight.back());
+                        in_flight.pop_back();
+                    }
+                };
+                return drive(submit, reap);
+            }
+#if defined(PERFLITE_HAS_COROUTINES)
+            else if constexpr (detail::is_awaitable_v<Operation>) {
+                auto submit = [&](size_t slot) {
+                    try {
+                        detail::await_then_complete(func(), Completion(state, slot));
+                    } catch (...) {
+                        state.fail(slot, std::current_exception());
+                    }
+                };
+                return drive(submit, poll);
+            }
+#endif
+            else {
+                static_assert(detail::is_future_like<Operation>::value,
+                              "run_async() needs a callable taking a Completion or returning a future or awaitable");
+                return 0.0;
+            }
+        }
+    }
+
+public:
+
+    // Runs the whole benchmark (calibration included) repetitions() times
+    // and summarizes the per-run means.
+    template<typename Func>
+    RepetitionResult run_repeated(Func&& func) const {
+        std::vector<BenchmarkResult> runs;
+        runs.reserve(repetitions_);
+        for (size_t i = 0; i < repetitions_; ++i) {
+            runs.push_back(run(func));
+            runs.back().repetition = i;
+        }
+        return aggregate_repetitions(std::move(runs));
+    }
+
+    // Runs the benchmark with a function and arguments. The arguments are
+    // bound by reference (temporaries live until run() returns) and passed
+    // to every call as lvalues; `func` may be any std::invoke-able callable,
+    // including a member pointer with the object as first argument.
+    template<typename Func, typename... Args,
+             typename = std::enable_if_t<(sizeof...(Args) > 0) && std::is_invocable_v<Func&, Args&...>>>
+    BenchmarkResult run(Func&& func, Args&&... args) const {
+        auto call = detail::bind_call(func, args...);
+        return run(call);
+    }
+
+    // Runs a function taking the input size once per point of the configured
+    // range (see range() and multiplier()) and returns one result per point,
+    // named "<name>/<n>". Pass the results to fit_complexity() for Big-O.
+    template<typename Func, typename = std::enable_if_t<std::is_invocable_v<Func, size_t>>>
+    std::vector<BenchmarkResult> run_range(Func&& func) const {
+        std::vector<BenchmarkResult> results;
+        for (size_t n : range_points()) {
+            Benchmark config = *this;
+            config.name(name_ + "/" + std::to_string(n));
+            results.push_back(config.run(func, n));
+            results.back().complexity_n = n;
+        }
+        return results;
+    }
+
+    // Input sizes of the configured range: range_start, multiplied by the
+    // multiplier until range_end, which is always included.
+    std::vector<size_t> range_points() const {
+        std::vector<size_t> points;
+        for (size_t n = range_start_; n < range_end_; n *= range_multiplier_) {
+            points.push_back(n);
+            if (n > range_end_ / range_multiplier_) {
+                break;
+            }
+        }
+        points.push_back(range_end_);
+        return points;
+    }
+};
+
+// Asymptotic complexity classes considered by fit_complexity().
+enum class Complexity {
+    O1,
+    OLogN,
+    ON,
+    ONLogN,
+    ON2
+};
+
+// Best least-squares fit of mean time against input size.
+struct ComplexityFit {
+    Complexity complexity = Complexity::O1;
+    double coefficient = 0.0;  // Time per unit of f(n), in the results' time unit
+    double rms = 0.0;          // RMS residual relative to the mean time
+    TimeUnit time_unit = TimeUnit::Nanoseconds;
+
+    // Big-O notation of the fitted class.
+    std::string label() const {
+        switch (complexity) {
+            case Complexity::O1: return "O(1)";
+            case Complexity::OLogN: return "O(log n)";
+            case Complexity::ON: return "O(n)";
+            case Complexity::ONLogN: return "O(n log n)";
+            case Complexity::ON2: return "O(n^2)";
+            default: return "unknown";
+        }
+    }
+
+    void print(std::ostream& os = std::cout) const {
+        const char* unit = (time_unit == TimeUnit::Nanoseconds) ? "ns" :
+                           (time_unit == TimeUnit::Microseconds) ? "µs" :
+                           (time_unit == TimeUnit::Milliseconds) ? "ms" : "s";
+        os << "Complexity: " << label() << "\n";
+        os << "  Coefficient: " << std::defaultfloat << std::setprecision(6) << coefficient << " " << unit << "\n";
+        os << "  RMS:         " << std::fixed << std::setprecision(2) << rms * 100.0 << " %\n\n";
+    }
+};
+
+// Fits y = c * f(n) for each complexity class to the mean times of range
+// results (complexity_n > 0) and returns the class with the smallest
+// normalized RMS error.
+inline ComplexityFit fit_complexity(const std::vector<BenchmarkResult>& results) {
+    auto f = [](Complexity c, double n) {
+        switch (c) {
+            case Complexity::O1: return 1.0;
+            case Complexity::OLogN: return std::log2(n);
+            case Complexity::ON: return n;
+            case Complexity::ONLogN: return n * std::log2(n);
+            case Complexity::ON2: return n * n;
+            default: return 1.0;
+        }
+    };
+
+    ComplexityFit best;
+    if (results.empty()) {
+        return best;
+    }
+    best.time_unit = results.front().time_unit;
+    double mean_y = 0.0;
+    for (const auto& r : results) {
+        mean_y += r.mean_time;
+    }
+    mean_y /= static_cast<double>(results.size());
+
+    bool first = true;
+    for (Complexity c : {Complexity::O1, Complexity::OLogN, Complexity::ON, Complexity::ONLogN, Complexity::ON2}) {
+        // Least squares through the origin: c = sum(y f) / sum(f^2)
+        double sum_yf = 0.0, sum_ff = 0.0;
+        for (const auto& r : results) {
+            const double fn = f(c, static_cast<double>(std::max<size_t>(r.complexity_n, 1)));
+            sum_yf += r.mean_time * fn;
+            sum_ff += fn * fn;
+        }
+        const double coefficient = (sum_ff > 0.0) ? sum_yf / sum_ff : 0.0;
+        double residual = 0.0;
+        for (const auto& r : results) {
+            const double fn = f(c, static_cast<double>(std::max<size_t>(r.complexity_n, 1)));
+            residual += (r.mean_time - coefficient * fn) * (r.mean_time - coefficient * fn);
+        }
+        const double rms = (mean_y > 0.0)
+            ? std::sqrt(residual / static_cast<double>(results.size())) / mean_y : 0.0;
+        if (first || rms < best.rms) {
+            best.complexity = c;
+            best.coefficient = coefficient;
+            best.rms = rms;
+            first = false;
+        }
+    }
+    return best;
+}
+
+// Convenience function for running a benchmark with default configuration.
+template<typename Func>
+BenchmarkResult benchmark(Func&& func) {
+    return Benchmark().run(std::forward<Func>(func));
+}
+
+template<typename Func, typename... Args>
+BenchmarkResult benchmark(Func&& func, Args&&... args) {
+    return Benchmark().run(std::forward<Func>(func), std::forward<Args>(args)...);
+}
+
+// Machine-readable reporters. JSON and CSV carry the statistics, the run
+// configuration and the environment of every result; the binary sample
+// file keeps the raw durations for later re-analysis.
+
+namespace detail {
+
+inline const char* time_unit_code(TimeUnit unit) {
+    switch (unit) {
+        case TimeUnit::Nanoseconds: return "ns";
+        case TimeUnit::Microseconds: return "us";
+        case TimeUnit::Milliseconds: return "ms";
+        case TimeUnit::Seconds: return "s";
+        default: return "unknown";
+    }
+}
+
+inline std::string json_escape(const std::string& text) {
+    std::string out;
+    out.reserve(text.size() + 2);
+    for (const char c : text) {
+        switch (c) {
+            case '"': out += "\\\""; break;
+            case '\\': out += "\\\\"; break;
+            case '\n': out += "\\n"; break;
+            case '\t': out += "\\t"; break;
+            case '\r': out += "\\r"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(static_cast<unsigned char>(c)));
+                    out += buf;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out;
+}
+
+// Shortest round-trippable text for a double; JSON has no NaN/Inf, so those
+// become null.
+inline std::string json_number(double value) {
+    if (!std::isfinite(value)) {
+        return "null";
+    }
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "%.15g", value);
+    if (std::strtod(buf, nullptr) != value) {
+        std::snprintf(buf, sizeof(buf), "%.17g", value);
+    }
+    return buf;
+}
+
+inline std::string csv_field(const std::string& text) {
+    if (text.find_first_of(",\"\n") == std::string::npos) {
+        return text;
+    }
+    std::string out = "\"";
+    for (const char c : text) {
+        out += c;
+        if (c == '"') {
+            out += '"';
+        }
+    }
+    return out + "\"";
+}
+
+inline std::string percentile_key(double level) {
+    std::ostringstream key;
+    key << "p" << std::defaultfloat << std::setprecision(6) << level;
+    return key.str();
+}
+
+} // namespace detail
+
+// Writes the results as one JSON document: {"benchmarks": [ ... ]}.
+// Times are in each result's time_unit; durations are not included (see
+// write_samples).
+inline void write_json(std::ostream& os, const std::vector<BenchmarkResult>& results) {
+    using detail::json_escape;
+    using detail::json_number;
+    os << "{\n  \"benchmarks\": [";
+    for (size_t i = 0; i < results.size(); ++i) {
+        const BenchmarkResult& r = results[i];
+        const EnvironmentInfo& env = r.environment;
+        os << (i ? "," : "") << "\n    {\n";
+        os << "      \"name\": \"" << json_escape(r.name) << "\",\n";
+        os << "      \"config\": {\"warmup_iterations\": " << r.warmup_iterations
+           << ", \"iterations\": " << r.iterations
+           << ", \"target_duration_ns\": " << json_number(r.target_duration_ns)
+           << ", \"batch_size\": " << r.batch_size
+           << ", \"threads\": " << r.threads
+           << ", \"clock\": \"" << (r.clock == ClockSource::CycleCounter ? "cycle_counter" : "chrono") << "\""
+           << ", \"streaming\": " << (r.streaming ? "true" : "false")
+           << ", \"subtract_overhead\": " << (r.subtract_overhead ? "true" : "false")
+           << ", \"complexity_n\": " << r.complexity_n
+           << ", \"confidence_target\": " << json_number(r.confidence_target)
+           << ", \"repetition\": " << r.repetition
+           << ", \"jobs\": " << r.jobs
+           << ", \"queue_depth\": " << r.queue_depth
+           << ", \"offered_ops_per_sec\": " << json_number(r.offered_ops_per_sec)
+           << ", \"cache\": \"" << (r.cache_mode == CacheMode::Cold ? "cold" : "warm") << "\"},\n";
+        os << "      \"time_unit\": \"" << detail::time_unit_code(r.time_unit) << "\",\n";
+        os << "      \"sample_count\": " << r.sample_count
+           << ", \"confidence_half_width\": " << json_number(r.confidence_half_width)
+           << ", \"converged\": " << (r.converged ? "true" : "false") << ",\n";
+        os << "      \"min\": " << json_number(r.min_time)
+           << ", \"mean\": " << json_number(r.mean_time)
+           << ", \"stddev\": " << json_number(r.stddev_time)
+           << ", \"median\": " << json_number(r.median_time)
+           << ", \"max\": " << json_number(r.max_time)
+           << ", \"mad\": " << json_number(r.mad_time) << ",\n";
+        os << "      \"outliers\": {\"low_severe\": " << r.outliers.low_severe
+           << ", \"low_mild\": " << r.outliers.low_mild
+           << ", \"high_mild\": " << r.outliers.high_mild
+           << ", \"high_severe\": " << r.outliers.high_severe
+           << ", \"fraction\": " << json_number(r.outlier_fraction) << "},\n";
+        os << "      \"inlier_mean\": " << json_number(r.inlier_mean_time)
+           << ", \"inlier_stddev\": " << json_number(r.inlier_stddev_time)
+           << ", \"trim_fraction\": " << json_number(r.trim_fraction)
+           << ", \"trimmed_mean\": " << json_number(r.trimmed_mean_time) << ",\n";
+        os << "      \"bytes_per_iteration\": " << json_number(r.bytes_per_iteration)
+           << ", \"bytes_per_sec\": " << json_number(r.bytes_per_sec)
+           << ", \"items_per_iteration\": " << json_number(r.items_per_iteration)
+           << ", \"items_per_sec\": " << json_number(r.items_per_sec) << ",\n";
+        os << "      \"ops_per_sec\": " << json_number(r.ops_per_sec)
+           << ", \"overhead\": " << json_number(r.overhead_time)
+           << ", \"cycles_per_ns\": " << json_number(r.cycles_per_ns)
+           << ", \"min_cycles\": " << json_number(r.min_cycles)
+           << ", \"mean_cycles\": " << json_number(r.mean_cycles) << ",\n";
+        os << "      \"percentiles\": {";
+        for (size_t p = 0; p < r.percentiles.size(); ++p) {
+            os << (p ? ", " : "") << "\"" << detail::percentile_key(r.percentiles[p].level) << "\": "
+               << json_number(r.percentiles[p].time);
+        }
+        os << "},\n      \"histogram\": [";
+        for (size_t b = 0; b < r.histogram.size(); ++b) {
+            os << (b ? ", " : "") << "[" << json_number(r.histogram[b].lower) << ", "
+               << json_number(r.histogram[b].upper) << ", " << r.histogram[b].count << "]";
+        }
+        os << "],\n      \"counters\": {";
+        for (size_t c = 0; c < r.counters.size(); ++c) {
+            os << (c ? ", " : "") << "\"" << json_escape(r.counters[c].name) << "\": "
+               << json_number(r.counters[c].per_iteration);
+        }
+        os << "}, \"ipc\": " << json_number(r.ipc) << ",\n";
+        os << "      \"aggregate_ops_per_sec\": " << json_number(r.aggregate_ops_per_sec)
+           << ", \"scaling_efficiency\": " << json_number(r.scaling_efficiency)
+           << ", \"thread_ops_per_sec\": [";
+        for (size_t t = 0; t < r.thread_ops_per_sec.size(); ++t) {
+            os << (t ? ", " : "") << json_number(r.thread_ops_per_sec[t]);
+        }
+        os << "],\n";
+        if (r.allocations_tracked) {
+            os << "      \"allocations\": {\"per_iteration\": " << json_number(r.allocations_per_iteration)
+               << ", \"bytes_per_iteration\": " << json_number(r.allocated_bytes_per_iteration)
+               << ", \"peak_live_bytes\": " << r.peak_live_bytes << "},\n";
+        }
+        if (r.memory_tracked) {
+            os << "      \"memory\": {\"minor_faults_per_iteration\": " << json_number(r.minor_faults_per_iteration)
+               << ", \"major_faults_per_iteration\": " << json_number(r.major_faults_per_iteration)
+               << ", \"voluntary_switches_per_iteration\": " << json_number(r.voluntary_switches_per_iteration)
+               << ", \"involuntary_switches_per_iteration\": " << json_number(r.involuntary_switches_per_iteration)
+               << ", \"rss_growth_bytes\": " << r.rss_growth_bytes
+               << ", \"peak_rss_growth_bytes\": " << r.peak_rss_growth_bytes << "},\n";
+        }
+        os << "      \"environment\": {\"logical_cpus\": " << env.logical_cpus
+           << ", \"cpu_model\": \"" << json_escape(env.cpu_model) << "\""
+           << ", \"governor\": \"" << json_escape(env.governor) << "\""
+           << ", \"turbo\": " << env.turbo
+           << ", \"load_average\": " << json_number(env.load_average)
+           << ", \"pinned_cpu\": " << env.pinned_cpu
+           << ", \"high_priority\": " << (env.high_priority ? "true" : "false") << "}\n";
+        os << "    }";
+    }
+    os << "\n  ]\n}\n";
+}
+
+// Writes one CSV row per result after a header row. Percentile columns are
+// the union of the levels requested across all results.
+inline void write_csv(std::ostream& os, const std::vector<BenchmarkResult>& results) {
+    std::vector<double> levels;
+    for (const auto& r : results) {
+        for (const auto& p : r.percentiles) {
+            if (std::none_of(levels.begin(), levels.end(), [&](double l) { return std::abs(l - p.level) < 1e-9; })) {
+                levels.push_back(p.level);
+            }
+        }
+    }
+    os << "name,time_unit,warmup_iterations,iterations,target_duration_ns,batch_size,threads,clock,"
+          "sample_count,confidence_target,confidence_half_width,converged,min,mean,stddev,median,max,mad,"
+          "outliers_low_severe,outliers_low_mild,outliers_high_mild,outliers_high_severe,inlier_mean,inlier_stddev,"
+          "trimmed_mean,ops_per_sec,bytes_per_iteration,bytes_per_sec,items_per_iteration,items_per_sec,"
+          "overhead,min_cycles,mean_cycles";
+    for (const double level : levels) {
+        os << "," << detail::percentile_key(level);
+    }
+    os << ",ipc,aggregate_ops_per_sec,scaling_efficiency,complexity_n,allocations_per_iteration,"
+          "allocated_bytes_per_iteration,peak_live_bytes,minor_faults_per_iteration,major_faults_per_iteration,"
+          "voluntary_switches_per_iteration,involuntary_switches_per_iteration,rss_growth_bytes,peak_rss_growth_bytes,"
+          "logical_cpus,cpu_model,governor,turbo,load_average,"
+          "pinned_cpu,high_priority\n";
+    auto num = [](double value) { return std::isfinite(value) ? detail::json_number(value) : std::string(); };
+    for (const auto& r : results) {
+        const EnvironmentInfo& env = r.environment;
+        os << detail::csv_field(r.name) << "," << detail::time_unit_code(r.time_unit) << ","
+           << r.warmup_iterations << "," << r.iterations << "," << num(r.target_duration_ns) << ","
+           << r.batch_size << "," << r.threads << ","
+           << (r.clock == ClockSource::CycleCounter ? "cycle_counter" : "chrono") << ","
+           << r.sample_count << "," << num(r.confidence_target) << "," << num(r.confidence_half_width) << ","
+           << (r.converged ? 1 : 0) << "," << num(r.min_time) << "," << num(r.mean_time) << ","
+           << num(r.stddev_time) << "," << num(r.median_time) << "," << num(r.max_time) << ","
+           << num(r.mad_time) << "," << r.outliers.low_severe << "," << r.outliers.low_mild << ","
+           << r.outliers.high_mild << "," << r.outliers.high_severe << "," << num(r.inlier_mean_time) << ","
+           << num(r.inlier_stddev_time) << "," << num(r.trimmed_mean_time) << "," << num(r.ops_per_sec) << ","
+           << num(r.bytes_per_iteration) << "," << num(r.bytes_per_sec) << "," << num(r.items_per_iteration) << ","
+           << num(r.items_per_sec) << "," << num(r.overhead_time) << ","
+           << num(r.min_cycles) << "," << num(r.mean_cycles);
+        for (const double level : levels) {
+            const bool present = std::any_of(r.percentiles.begin(), r.percentiles.end(),
+                                             [&](const Percentile& p) { return std::abs(p.level - level) < 1e-9; });
+            os << "," << (present ? num(r.percentile(level)) : std::string());
+        }
+        os << "," << num(r.ipc) << "," << num(r.aggregate_ops_per_sec) << "," << num(r.scaling_efficiency) << ","
+           << r.complexity_n << ",";
+        if (r.allocations_tracked) {
+            os << num(r.allocations_per_iteration) << "," << num(r.allocated_bytes_per_iteration) << ","
+               << r.peak_live_bytes;
+        } else {
+            os << ",,";
+        }
+        os << ",";
+        if (r.memory_tracked) {
+            os << num(r.minor_faults_per_iteration) << "," << num(r.major_faults_per_iteration) << ","
+               << num(r.voluntary_switches_per_iteration) << "," << num(r.involuntary_switches_per_iteration) << ","
+               << r.rss_growth_bytes << "," << r.peak_rss_growth_bytes;
+        } else {
+            os << ",,,,,";
+        }
+        os << "," << env.logical_cpus << "," << detail::csv_field(env.cpu_model) << ","
+           << detail::csv_field(env.governor) << "," << env.turbo << "," << num(env.load_average) << ","
+           << env.pinned_cpu << "," << (env.high_priority ? 1 : 0) << "\n";
+    }
+}
+
+// Raw samples of one benchmark as stored in a binary sample file.
+struct SampleSet {
+    std::string name;
+    size_t batch_size = 1;
+    std::vector<std::chrono::duration<double, std::nano>> durations;  // Per-call nanoseconds
+};
+
+// Binary sample file layout (native byte order, checked on read):
+//   "PLSAMPLE" | uint32 version | uint32 0x01020304
+//   per result: uint32 name length | name | uint64 batch size | uint64 count | count doubles (ns)
+namespace detail {
+constexpr char kSampleMagic[8] = {'P', 'L', 'S', 'A', 'M', 'P', 'L', 'E'};
+constexpr uint32_t kSampleVersion = 1;
+constexpr uint32_t kSampleByteOrder = 0x01020304;
+
+static_assert(sizeof(std::chrono::duration<double, std::nano>) == sizeof(double),
+              "durations must be stored as plain doubles");
+
+// Upper bounds on header fields read back from a sample file, so a corrupt
+// length cannot drive a huge allocation on a non-seekable stream.
+constexpr uint32_t kMaxSampleNameSize = 1u << 16;
+constexpr uint64_t kMaxSampleCount = uint64_t{1} << 28;
+
+template<typename T>
+void append_raw(std::string& buffer, const T& value) {
+    buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+}
+
+// Bytes left between the read position and the end of `is`, or -1 when the
+// stream cannot seek.
+inline std::streamoff remaining_bytes(std::istream& is) {
+    const std::streampos here = is.tellg();
+    if (here == std::streampos(-1)) {
+        is.clear();
+        return -1;
+    }
+    is.seekg(0, std::ios::end);
+    const std::streampos end = is.tellg();
+    is.seekg(here);
+    if (end == std::streampos(-1) || !is) {
+        is.clear();
+        is.seekg(here);
+        return -1;
+    }
+    return end - here;
+}
+
+// True when `bytes` more bytes can plausibly be read from `is`.
+inline bool fits_in_stream(std::istream& is, uint64_t bytes) {
+    const std::streamoff left = remaining_bytes(is);
+    return left < 0 || bytes <= static_cast<uint64_t>(left);
+}
+} // namespace detail
+
+// Writes the raw durations of each result. Each result costs two stream
+// writes (a small header and the whole sample array), however many samples
+// it holds. Streaming-mode results have no durations and store zero samples.
+inline bool write_samples(std::ostream& os, const std::vector<BenchmarkResult>& results) {
+    std::string header(detail::kSampleMagic, sizeof(detail::kSampleMagic));
+    detail::append_raw(header, detail::kSampleVersion);
+    detail::append_raw(header, detail::kSampleByteOrder);
+    os.write(header.data(), static_cast<std::streamsize>(header.size()));
+    for (const auto& r : results) {
+        header.clear();
+        detail::append_raw(header, static_cast<uint32_t>(r.name.size()));
+        header += r.name;
+        detail::append_raw(header, static_cast<uint64_t>(r.batch_size));
+        detail::append_raw(header, static_cast<uint64_t>(r.durations.size()));
+        os.write(header.data(), static_cast<std::streamsize>(header.size()));
+        os.write(reinterpret_cast<const char*>(r.durations.data()),
+                 static_cast<std::streamsize>(r.durations.size() * sizeof(double)));
+    }
+    return static_cast<bool>(os);
+}
+
+// Reads a file written by write_samples(). Returns false and writes a
+// message to `err` on a malformed, truncated or foreign-endian file. Header
+// lengths are checked against the bytes left in the stream before anything
+// is allocated.
+inline bool read_samples(std::istream& is, std::vector<SampleSet>& sets, std::ostream& err = std::cerr) {
+    char magic[sizeof(detail::kSampleMagic)];
+    uint32_t version = 0;
+    uint32_t byte_order = 0;
+    is.read(magic, sizeof(magic));
+    is.read(reinterpret_cast<char*>(&version), sizeof(version));
+    is.read(reinterpret_cast<char*>(&byte_order), sizeof(byte_order));
+    if (!is || !std::equal(magic, magic + sizeof(magic), detail::kSampleMagic)) {
+        err << "Error: not a PerfLite sample file\n";
+        return false;
+    }
+    if (version != detail::kSampleVersion || byte_order != detail::kSampleByteOrder) {
+        err << "Error: unsupported sample file version or byte order\n";
+        return false;
+    }
+    while (is.peek() != std::char_traits<char>::eof()) {
+        SampleSet set;
+        uint32_t name_size = 0;
+        uint64_t batch = 0;
+        uint64_t count = 0;
+        is.read(reinterpret_cast<char*>(&name_size), sizeof(name_size));
+        if (!is || name_size > detail::kMaxSampleNameSize || !detail::fits_in_stream(is, name_size)) {
+            err << "Error: truncated or corrupt sample file (benchmark name)\n";
+            return false;
+        }
+        set.name.resize(name_size);
+        is.read(&set.name[0], name_size);
+        is.read(reinterpret_cast<char*>(&batch), sizeof(batch));
+        is.read(reinterpret_cast<char*>(&count), sizeof(count));
+        if (!is) {
+            err << "Error: truncated sample file\n";
+            return false;
+        }
+        if (count > detail::kMaxSampleCount || !detail::fits_in_stream(is, count * sizeof(double))) {
+            err << "Error: truncated or corrupt sample file ('" << set.name << "' claims " << count
+                << " samples)\n";
+            return false;
+        }
+        set.batch_size = static_cast<size_t>(batch);
+        set.durations.resize(static_cast<size_t>(count));
+        is.read(reinterpret_cast<char*>(set.durations.data()), static_cast<std::streamsize>(count * sizeof(double)));
+        if (!is) {
+            err << "Error: truncated sample file\n";
+            return false;
+        }
+        sets.push_back(std::move(set));
+    }
+    return true;
+}
+
+// Baseline comparison: loads a previous JSON report (and optionally its
+// binary sample file) and tests each fresh result against it.
+
+// One benchmark of a baseline run. Times are in nanoseconds.
+struct BaselineEntry {
+    std::string name;
+    double mean_ns = 0.0;
+    double stddev_ns = 0.0;
+    size_t sample_count = 0;
+    std::vector<double> samples_ns;  // Raw samples if a sample file was loaded
+};
+
+namespace detail {
+
+// Minimal JSON document model, enough to read write_json() output back.
+struct JsonValue {
+    enum class Type { Null, Bool, Number, String, Array, Object } type = Type::Null;
+    double number = 0.0;
+    std::string text;
+    std::vector<JsonValue> items;
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* find(const std::string& key) const {
+        for (const auto& m : members) {
+            if (m.first == key) {
+                return &m.second;
+            }
+        }
+        return nullptr;
+    }
+
+    double number_or(const std::string& key, double fallback) const {
+        const JsonValue* v = find(key);
+        return (v && v->type == Type::Number) ? v->number : fallback;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& input) : input_(input) {}
+
+    // Parses the whole input; returns false on a syntax error.
+    bool parse(JsonValue& out) {
+        if (!value(out)) {
+            return false;
+        }
+        skip_space();
+        return pos_ == input_.size();
+    }
+
+    size_t position() const { return pos_; }
+
+private:
+    void skip_space() {
+        while (pos_ < input_.size() && std::isspace(static_cast<unsigned char>(input_[pos_]))) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char c) {
+        skip_space();
+        if (pos_ < input_.size() && input_[pos_] == c) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    bool literal(const char* word) {
+        const size_t size = std::char_traits<char>::length(word);
+        if (input_.compare(pos_, size, word) != 0) {
+            return false;
+        }
+        pos_ += size;
+        return true;
+    }
+
+    bool string(std::string& out) {
+        if (!consume('"')) {
+            return false;
+        }
+        while (pos_ < input_.size()) {
+            const char c = input_[pos_++];
+            if (c == '"') {
+                return true;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= input_.size()) {
+                return false;
+            }
+            const char e = input_[pos_++];
+            switch (e) {
+                case 'n': out += '\n'; break;
+                case 't': out += '\t'; break;
+                case 'r': out += '\r'; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'u': {
+                    if (pos_ + 4 > input_.size()) {
+                        return false;
+                    }
+                    const unsigned long code = std::strtoul(input_.substr(pos_, 4).c_str(), nullptr, 16);
+                    out += (code < 0x80) ? static_cast<char>(code) : '?';
+                    pos_ += 4;
+                    break;
+                }
+                default: out += e;
+            }
+        }
+        return false;
+    }
+
+    bool value(JsonValue& out) {
+        skip_space();
+        if (pos_ >= input_.size()) {
+            return false;
+        }
+        const char c = input_[pos_];
+        if (c == '{') {
+            ++pos_;
+            out.type = JsonValue::Type::Object;
+            if (consume('}')) {
+                return true;
+            }
+            do {
+                std::string key;
+                JsonValue member;
+                if (!string(key) || !consume(':') || !value(member)) {
+                    return false;
+                }
+                out.members.emplace_back(std::move(key), std::move(member));
+            } while (consume(','));
+            return consume('}');
+        }
+        if (c == '[') {
+            ++pos_;
+            out.type = JsonValue::Type::Array;
+            if (consume(']')) {
+                return true;
+            }
+            do {
+                JsonValue item;
+                if (!value(item)) {
+                    return false;
+                }
+                out.items.push_back(std::move(item));
+            } while (consume(','));
+            return consume(']');
+        }
+        if (c == '"') {
+            out.type = JsonValue::Type::String;
+            return string(out.text);
+        }
+        if (literal("true")) {
+            out.type = JsonValue::Type::Bool;
+            out.number = 1.0;
+            return true;
+        }
+        if (literal("false")) {
+            out.type = JsonValue::Type::Bool;
+            return true;
+        }
+        if (literal("null")) {
+            out.type = JsonValue::Type::Null;
+            return true;
+        }
+        const char* begin = input_.c_str() + pos_;
+        char* end = nullptr;
+        out.number = std::strtod(begin, &end);
+        if (end == begin) {
+            return false;
+        }
+        out.type = JsonValue::Type::Number;
+        pos_ += static_cast<size_t>(end - begin);
+        return true;
+    }
+
+    const std::string& input_;
+    size_t pos_ = 0;
+};
+
+inline double ns_per_unit(const std::string& unit) {
+    if (unit == "us") return 1e3;
+    if (unit == "ms") return 1e6;
+    if (unit == "s") return 1e9;
+    return 1.0;
+}
+
+inline double ns_per_unit(TimeUnit unit) {
+    return ns_per_unit(std::string(time_unit_code(unit)));
+}
+
+// Regularized incomplete beta I_x(a, b) by Lentz's continued fraction.
+inline double incomplete_beta(double a, double b, double x) {
+    if (x <= 0.0) return 0.0;
+    if (x >= 1.0) return 1.0;
+    if (x > (a + 1.0) / (a + b + 2.0)) {
+        return 1.0 - incomplete_beta(b, a, 1.0 - x);
+    }
+    const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) +
+                                  a * std::log(x) + b * std::log1p(-x)) / a;
+    constexpr double kTiny = 1e-300;
+    double f = 1.0, c = 1.0, d = 0.0;
+    for (int i = 0; i <= 10000; ++i) {
+        const int m = i / 2;
+        double numerator;
+        if (i == 0) {
+            numerator = 1.0;
+        } else if (i % 2 == 0) {
+            numerator = (m * (b - m) * x) / ((a + 2.0 * m - 1.0) * (a + 2.0 * m));
+        } else {
+            numerator = -((a + m) * (a + b + m) * x) / ((a + 2.0 * m) * (a + 2.0 * m + 1.0));
+        }
+        d = 1.0 + numerator * d;
+        d = 1.0 / (std::abs(d) < kTiny ? kTiny : d);
+        c = 1.0 + numerator / c;
+        c = std::abs(c) < kTiny ? kTiny : c;
+        f *= c * d;
+        if (std::abs(1.0 - c * d) < 1e-12) {
+            break;
+        }
+    }
+    return front * (f - 1.0);
+}
+
+// Two-sided p-value of a Student t statistic; large df use the normal limit.
+inline double student_t_two_sided_p(double t, double df) {
+    if (!std::isfinite(t)) return 0.0;
+    if (df > 1e4) {
+        return std::erfc(std::abs(t) / std::sqrt(2.0));
+    }
+    return incomplete_beta(df / 2.0, 0.5, df / (df + t * t));
+}
+
+// Critical value t such that student_t_two_sided_p(t, df) == alpha.
+inline double student_t_critical(double alpha, double df) {
+    double lo = 0.0, hi = 1e3;
+    for (int i = 0; i < 200; ++i) {
+        const double mid = 0.5 * (lo + hi);
+        (student_t_two_sided_p(mid, df) > alpha ? lo : hi) = mid;
+    }
+    return 0.5 * (lo + hi);
+}
+
+// Two-sided Mann-Whitney U p-value (normal approximation with tie
+// correction) for the hypothesis that both samples share a distribution.
+inline double mann_whitney_p(const std::vector<double>& a, const std::vector<double>& b) {
+    std::vector<std::pair<double, bool>> all;
+    all.reserve(a.size() + b.size());
+    for (const double v : a) all.emplace_back(v, true);
+    for (const double v : b) all.emplace_back(v, false);
+    std::sort(all.begin(), all.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+    double rank_sum_a = 0.0;
+    double tie_term = 0.0;
+    for (size_t i = 0; i < all.size();) {
+        size_t j = i;
+        while (j < all.size() && all[j].first == all[i].first) {
+            ++j;
+        }
+        const double rank = 0.5 * static_cast<double>(i + 1 + j);  // Average of ranks i+1..j
+        for (size_t k = i; k < j; ++k) {
+            if (all[k].second) rank_sum_a += rank;
+        }
+        const double ties = static_cast<double>(j - i);
+        tie_term += ties * ties * ties - ties;
+        i = j;
+    }
+    const double n1 = static_cast<double>(a.size());
+    const double n2 = static_cast<double>(b.size());
+    const double n = n1 + n2;
+    const double u = rank_sum_a - n1 * (n1 + 1.0) / 2.0;
+    const double sigma = std::sqrt(n1 * n2 / 12.0 * ((n + 1.0) - tie_term / (n * (n - 1.0))));
+    if (sigma <= 0.0) {
+        return 1.0;
+    }
+    const double z = (std::abs(u - n1 * n2 / 2.0) - 0.5) / sigma;
+    return std::erfc(std::max(z, 0.0) / std::sqrt(2.0));
+}
+
+} // namespace detail
+
+// Reads a write_json() report. Returns false and writes a message to `err`
+// if the document cannot be parsed.
+inline bool read_baseline_json(std::istream& is, std::vector<BaselineEntry>& entries, std::ostream& err = std::cerr) {
+    const std::string text((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+    detail::JsonValue root;
+    detail::JsonParser parser(text);
+    if (!parser.parse(root)) {
+        err << "Error: invalid JSON baseline near offset " << parser.position() << "\n";
+        return false;
+    }
+    const detail::JsonValue* benchmarks = root.find("benchmarks");
+    if (!benchmarks || benchmarks->type != detail::JsonValue::Type::Array) {
+        err << "Error: baseline has no \"benchmarks\" array\n";
+        return false;
+    }
+    for (const auto& b : benchmarks->items) {
+        const detail::JsonValue* name = b.find("name");
+        const detail::JsonValue* unit = b.find("time_unit");
+        if (!name || name->type != detail::JsonValue::Type::String) {
+            continue;
+        }
+        const double scale = detail::ns_per_unit(unit ? unit->text : std::string("ns"));
+        BaselineEntry entry;
+        entry.name = name->text;
+        entry.mean_ns = b.number_or("mean", 0.0) * scale;
+        entry.stddev_ns = b.number_or("stddev", 0.0) * scale;
+        entry.sample_count = static_cast<size_t>(b.number_or("sample_count", 0.0));
+        entries.push_back(std::move(entry));
+    }
+    return true;
+}
+
+// Attaches raw samples from a write_samples() file to the matching entries
+// (adding entries for sets that have no JSON counterpart).
+inline void attach_baseline_samples(std::vector<BaselineEntry>& entries, const std::vector<SampleSet>& sets) {
+    for (const auto& set : sets) {
+        if (set.durations.empty()) {
+            continue;
+        }
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const BaselineEntry& e) { return e.name == set.name; });
+        if (it == entries.end()) {
+            entries.emplace_back();
+            it = std::prev(entries.end());
+            it->name = set.name;
+        }
+        it->samples_ns.resize(set.durations.size());
+        std::transform(set.durations.begin(), set.durations.end(), it->samples_ns.begin(),
+                       [](std::chrono::duration<double, std::nano> d) { return d.count(); });
+        if (it->sample_count == 0) {
+            OnlineStatistics stats;
+            for (const double v : it->samples_ns) {
+                stats.add(v);
+            }
+            it->mean_ns = stats.mean;
+            it->stddev_ns = std::sqrt(stats.variance());
+            it->sample_count = static_cast<size_t>(stats.count);
+        }
+    }
+}
+
+struct CompareOptions {
+    double threshold = 0.05;  // Minimum relative slowdown that counts as a regression
+    double alpha = 0.05;      // Significance level of the test and 1 - CI coverage
+};
+
+// Outcome of comparing one benchmark against its baseline. Delta and its
+// confidence interval are relative to the baseline mean (0.1 = 10% slower).
+struct Comparison {
+    std::string name;
+    std::string test;          // "welch" or "mann-whitney"
+    double baseline_ns = 0.0;
+    double current_ns = 0.0;
+    double delta = 0.0;
+    double ci_low = 0.0;
+    double ci_high = 0.0;
+    double p_value = 1.0;
+    double alpha = 0.05;
+    bool significant = false;
+    bool regression = false;   // Significant and slower by more than the threshold
+    bool improvement = false;  // Significant and faster by more than the threshold
+
+    void print(std::ostream& os = std::cout) const {
+        const std::streamsize precision = os.precision();
+        os << "Compare: " << name << "\n" << std::fixed << std::setprecision(2);
+        os << "  Baseline: " << baseline_ns << " ns, current: " << current_ns << " ns\n";
+        os << "  Delta:    " << std::showpos << delta * 100.0 << std::noshowpos << " % ["
+           << std::defaultfloat << (1.0 - alpha) * 100.0 << "% CI " << std::fixed << std::showpos
+           << ci_low * 100.0 << " %, " << ci_high * 100.0 << " %]" << std::noshowpos
+           << ", p = " << std::setprecision(4) << p_value << " (" << test << ")";
+        if (regression) {
+            os << " REGRESSION";
+        } else if (improvement) {
+            os << " improvement";
+        }
+        os << "\n\n" << std::setprecision(static_cast<int>(precision));
+    }
+};
+
+// Compares a fresh result with its baseline. The p-value comes from a
+// Mann-Whitney U test when raw samples exist on both sides and from
+// Welch's t-test otherwise; the interval is Welch's interval on the mean
+// difference in both cases.
+inline Comparison compare(const BaselineEntry& baseline, const BenchmarkResult& current,
+                          const CompareOptions& options = CompareOptions()) {
+    assert(options.alpha > 0.0 && options.alpha < 1.0 && "alpha must be in (0, 1)");
+    const double scale = detail::ns_per_unit(current.time_unit);
+    Comparison c;
+    c.name = current.name;
+    c.alpha = options.alpha;
+    c.baseline_ns = baseline.mean_ns;
+    c.current_ns = current.mean_time * scale;
+
+    const double n1 = static_cast<double>(baseline.sample_count);
+    const double n2 = static_cast<double>(current.sample_count);
+    const double v1 = baseline.stddev_ns * baseline.stddev_ns / std::max(n1, 1.0);
+    const double v2 = std::pow(current.stddev_time * scale, 2.0) / std::max(n2, 1.0);
+    const double se = std::sqrt(v1 + v2);
+    const double diff = c.current_ns - c.baseline_ns;
+    double df = 1.0;
+    if (n1 > 1.0 && n2 > 1.0 && se > 0.0) {
+        df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1.0) + v2 * v2 / (n2 - 1.0));
+    }
+    const double t = (se > 0.0) ? diff / se : (diff == 0.0 ? 0.0 : std::copysign(INFINITY, diff));
+    const double margin = detail::student_t_critical(options.alpha, df) * se;
+
+    if (!baseline.samples_ns.empty() && !current.durations.empty()) {
+        std::vector<double> fresh(current.durations.size());
+        std::transform(current.durations.begin(), current.durations.end(), fresh.begin(),
+                       [](std::chrono::duration<double, std::nano> d) { return d.count(); });
+        c.test = "mann-whitney";
+        c.p_value = detail::mann_whitney_p(baseline.samples_ns, fresh);
+    } else {
+        c.test = "welch";
+        c.p_value = detail::student_t_two_sided_p(t, df);
+    }
+
+    if (c.baseline_ns > 0.0) {
+        c.delta = diff / c.baseline_ns;
+        c.ci_low = (diff - margin) / c.baseline_ns;
+        c.ci_high = (diff + margin) / c.baseline_ns;
+    }
+    c.significant = c.p_value < options.alpha;
+    c.regression = c.significant && c.delta > options.threshold;
+    c.improvement = c.significant && c.delta < -options.threshold;
+    return c;
+}
+
+// Compares every result that has a baseline entry of the same name.
+inline std::vector<Comparison> compare(const std::vector<BaselineEntry>& baseline,
+                                       const std::vector<BenchmarkResult>& results,
+                                       const CompareOptions& options = CompareOptions()) {
+    std::vector<Comparison> comparisons;
+    for (const auto& r : results) {
+        auto it = std::find_if(baseline.begin(), baseline.end(), [&](const BaselineEntry& e) { return e.name == r.name; });
+        if (it != baseline.end()) {
+            comparisons.push_back(compare(*it, r, options));
+        }
+    }
+    return comparisons;
+}
+
+namespace detail {
+
+// Unserialized counter read for probes: cheaper than CycleClock::start(), at
+// the cost of letting a few instructions drift across the scope boundary.
+inline uint64_t probe_ticks() {
+#if defined(PERFLITE_HAS_TSC)
+    return __rdtsc();
+#elif defined(PERFLITE_HAS_CNTVCT)
+    uint64_t t;
+    asm volatile("mrs %0, cntvct_el0" : "=r"(t));
+    return t;
+#else
+    return ChronoClock::start();
+#endif
+}
+
+// Single-producer/single-consumer ring of probe events, written by one
+// thread and drained by ProbeRegistry. An event holds the start tick and
+// packs the site index into the top 16 bits and the duration in ticks into
+// the low 48; pushes to a full ring are dropped and counted, not blocked.
+class ProbeRing {
+public:
+    static constexpr size_t kCapacity = size_t(1) << 16;
+    static constexpr unsigned kTickBits = 48;
+    static constexpr uint64_t kTickMask = (uint64_t(1) << kTickBits) - 1;
+
+    explicit ProbeRing(uint32_t thread_index = 0)
+        : thread_index_(thread_index), events_(new Event[kCapacity]) {}
+
+    void push(uint32_t site, uint64_t start, uint64_t ticks) {
+        const uint64_t head = head_.load(std::memory_order_relaxed);
+        if (head - tail_.load(std::memory_order_acquire) >= kCapacity) {
+            dropped_.store(dropped_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return;
+        }
+        events_[head & (kCapacity - 1)] = Event{start, (uint64_t(site) << kTickBits) | std::min(ticks, kTickMask)};
+        head_.store(head + 1, std::memory_order_release);
+    }
+
+    // Calls sink(site, start, ticks) for every pending event. Consumer side only.
+    template<typename Sink>
+    void drain(Sink&& sink) {
+        const uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t tail = tail_.load(std::memory_order_relaxed);
+        for (; tail != head; ++tail) {
+            const Event& event = events_[tail & (kCapacity - 1)];
+            sink(static_cast<uint32_t>(event.packed >> kTickBits), event.start, event.packed & kTickMask);
+        }
+        tail_.store(tail, std::memory_order_release);
+    }
+
+    // Drops since the last reset_dropped(). Consumer side only.
+    uint64_t dropped() const { return dropped_.load(std::memory_order_relaxed) - dropped_base_; }
+    // Restarts the drop count. The producer's counter is left untouched, so a
+    // concurrent push cannot lose the reset.
+    void reset_dropped() { dropped_base_ = dropped_.load(std::memory_order_relaxed); }
+    // Registration order of the owning thread, used as its trace track.
+    uint32_t thread_index() const { return thread_index_; }
+
+private:
+    struct Event {
+        uint64_t start;
+        uint64_t packed;
+    };
+
+    alignas(64) std::atomic<uint64_t> head_{0};     // Producer line
+    std::atomic<uint64_t> dropped_{0};
+    alignas(64) std::atomic<uint64_t> tail_{0};     // Consumer line
+    uint64_t dropped_base_ = 0;
+    const uint32_t thread_index_;
+    std::unique_ptr<Event[]> events_;
+};
+
+} // namespace detail
+
+// Streams a Chrome Trace Event JSON document, loadable in chrome://tracing
+// and the Perfetto UI, to `os`. Events are buffered and written in chunks of
+// about `chunk_bytes`, so a trace never has to fit in memory. Timestamps are
+// steady-clock nanoseconds (CLOCK_MONOTONIC on Linux), which lines samples and
+// probes up with each other and with other tools using the same clock.
+// Benchmark samples go on one track per benchmark, probes on one track per
+// thread. Safe to use concurrently with the probe aggregator.
+class TraceWriter {
+public:
+    static constexpr size_t kDefaultChunkBytes = size_t(1) << 20;
+    static constexpr uint32_t kSamplesPid = 1;
+    static constexpr uint32_t kProbesPid = 2;
+
+    explicit TraceWriter(std::ostream& os, size_t chunk_bytes = kDefaultChunkBytes)
+        : os_(os), chunk_bytes_(chunk_bytes) {
+        buffer_.reserve(chunk_bytes_ + 512);
+        os_ << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        metadata("process_name", kSamplesPid, 0, "PerfLite samples");
+        metadata("process_name", kProbesPid, 0, "PerfLite probes");
+    }
+
+    ~TraceWriter() {
+        close();
+    }
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // One complete ("X") event.
+    void complete(const std::string& name, uint32_t pid, uint32_t tid, double start_ns, double duration_ns) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        char times[96];
+        std::snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f", start_ns / 1e3, duration_ns / 1e3);
+        begin_event();
+        buffer_ += "{\"name\":\"";
+        buffer_ += detail::json_escape(name);
+        buffer_ += "\",\"ph\":\"X\",\"pid\":";
+        buffer_ += std::to_string(pid);
+        buffer_ += ",\"tid\":";
+        buffer_ += std::to_string(tid);
+        buffer_ += ',';
+        buffer_ += times;
+        buffer_ += '}';
+        ++events_;
+        flush_if_full();
+    }
+
+    // Names the track of thread `tid` in process `pid`.
+    void name_track(uint32_t pid, uint32_t tid, const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        metadata("thread_name", pid, tid, name);
+    }
+
+    // Adds every sample of a run with record_timestamps() as one event on a
+    // new track named after the benchmark; each event spans the sample's
+    // whole timed block. Returns false if the result has no timestamps.
+    bool add_samples(const BenchmarkResult& result) {
+        if (result.sample_starts_ns.empty() || result.sample_starts_ns.size() != result.durations.size()) {
+            return false;
+        }
+        uint32_t tid;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            tid = ++sample_tracks_;
+        }
+        name_track(kSamplesPid, tid, result.name);
+        const double batch = static_cast<double>(std::max<size_t>(1, result.batch_size));
+        for (size_t i = 0; i < result.durations.size(); ++i) {
+            complete(result.name, kSamplesPid, tid, result.sample_starts_ns[i], result.durations[i].count() * batch);
+        }
+        return true;
+    }
+
+    // Writes the buffered events.
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        write_buffer();
+        os_.flush();
+    }
+
+    // Flushes and terminates the document. Further events are ignored.
+    void close() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (closed_) {
+            return;
+        }
+        write_buffer();
+        os_ << "]}\n";
+        os_.flush();
+        closed_ = true;
+    }
+
+    uint64_t events() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return events_;
+    }
+
+private:
+    void metadata(const char* kind, uint32_t pid, uint32_t tid, const std::string& name) {
+        if (closed_) {
+            return;
+        }
+        begin_event();
+        buffer_ += "{\"name\":\"";
+        buffer_ += kind;
+        buffer_ += "\",\"ph\":\"M\",\"pid\":";
+        buffer_ += std::to_string(pid);
+        buffer_ += ",\"tid\":";
+        buffer_ += std::to_string(tid);
+        buffer_ += ",\"args\":{\"name\":\"";
+        buffer_ += detail::json_escape(name);
+        buffer_ += "\"}}";
+        flush_if_full();
+    }
+
+    void begin_event() {
+        if (wrote_any_) {
+            buffer_ += ",\n";
+        } else {
+            buffer_ += '\n';
+            wrote_any_ = true;
+        }
+    }
+
+    void flush_if_full() {
+        if (buffer_.size() >= chunk_bytes_) {
+            write_buffer();
+        }
+    }
+
+    void write_buffer() {
+        if (!closed_) {
+            os_.write(buffer_.data(), static_cast<std::streamsize>(buffer_.size()));
+        }
+        buffer_.clear();
+    }
+
+    std::ostream& os_;
+    size_t chunk_bytes_;
+    std::string buffer_;
+    mutable std::mutex mutex_;
+    uint64_t events_ = 0;
+    uint32_t sample_tracks_ = 0;
+    bool wrote_any_ = false;
+    bool closed_ = false;
+};
+
+// Process-wide state behind PERFLITE_SCOPE: the probe sites, every thread's
+// event ring and one streaming accumulator per site. Draining happens on
+// flush(), results() or from the background aggregator, never on the
+// probing thread, so rings of threads that have exited are drained too.
+class ProbeRegistry {
+public:
+    static constexpr uint32_t kMaxSites = uint32_t(1) << (64 - detail::ProbeRing::kTickBits);
+
+    static ProbeRegistry& instance() {
+        static ProbeRegistry registry;
+        return registry;
+    }
+
+    // Index of the site called `name`, registered on first use. Probes
+    // sharing a name share their statistics.
+    uint32_t site(const std::string& name) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name) {
+                return static_cast<uint32_t>(i);
+            }
+        }
+        assert(names_.size() < kMaxSites && "Too many probe sites");
+        names_.push_back(name);
+        stats_.emplace_back();
+        return static_cast<uint32_t>(names_.size() - 1);
+    }
+
+    // The calling thread's ring, allocated and registered on its first probe.
+    detail::ProbeRing& ring() {
+        thread_local ThreadRing local(*this);
+        return *local.ring;
+    }
+
+    // Folds every pending event into the per-site statistics.
+    void flush() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain_locked();
+    }
+
+    // Starts a thread that flushes every `interval`, so that rings of busy
+    // threads do not fill up (and drop events) in long-running processes.
+    void start_aggregator(std::chrono::milliseconds interval = std::chrono::milliseconds(10)) {
+        assert(interval.count() > 0 && "Aggregator interval must be greater than zero");
+        stop_aggregator();
+        stop_.store(false);
+        aggregator_ = std::thread([this, interval] {
+            while (!stop_.load()) {
+                flush();
+                std::this_thread::sleep_for(interval);
+            }
+        });
+    }
+
+    void stop_aggregator() {
+        if (aggregator_.joinable()) {
+            stop_.store(true);
+            aggregator_.join();
+        }
+    }
+
+    // Flushes, then returns one streaming result per site that recorded at
+    // least one event, in registration order, for print() and the reporters.
+    std::vector<BenchmarkResult> results(TimeUnit unit = TimeUnit::Nanoseconds) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain_locked();
+        std::vector<BenchmarkResult> out;
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (stats_[i].count == 0) {
+                continue;
+            }
+            BenchmarkResult result(unit);
+            result.name = names_[i];
+            result.streaming = true;
+            result.online = stats_[i];
+            result.iterations = static_cast<size_t>(stats_[i].count);
+            result.calculate_statistics();
+            out.push_back(std::move(result));
+        }
+        return out;
+    }
+
+    // Events dropped because a ring was full.
+    uint64_t dropped() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t total = retired_dropped_;
+        for (const auto& ring : rings_) {
+            total += ring->dropped();
+        }
+        return total;
+    }
+
+    // Also writes every probe event drained from now on to `writer`, one
+    // track per thread; nullptr stops. The writer must outlive the tracing.
+    void trace_to(TraceWriter* writer) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain_locked();
+        trace_ = writer;
+        traced_threads_.clear();
+    }
+
+    // Discards pending events, collected statistics and drop counts; sites
+    // stay registered.
+    void reset() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        drain_locked();
+        for (auto& stats : stats_) {
+            stats = OnlineStatistics();
+        }
+        for (auto& ring : rings_) {
+            ring->reset_dropped();
+        }
+        retired_dropped_ = 0;
+    }
+
+    ~ProbeRegistry() {
+        stop_aggregator();
+    }
+
+private:
+    // Owner of a thread's ring. The registry holds a second reference so
+    // that events still pending when the thread exits are not lost.
+    struct ThreadRing {
+        std::shared_ptr<detail::ProbeRing> ring;
+
+        explicit ThreadRing(ProbeRegistry& registry) {
+            std::lock_guard<std::mutex> lock(registry.mutex_);
+            ring = std::make_shared<detail::ProbeRing>(registry.next_thread_++);
+            registry.rings_.push_back(ring);
+        }
+    };
+
+    // Pairs a probe tick with the steady clock, so that traced probes share
+    // the timebase of benchmark sample timestamps.
+    ProbeRegistry() : anchor_ns_(detail::steady_now_ns()), anchor_tick_(detail::probe_ticks()) {}
+
+    void drain_locked() {
+        const double ns_per_tick = probe_ns_per_tick();
+        for (auto it = rings_.begin(); it != rings_.end();) {
+            // A use count of 1 means the owning thread has exited; the fence
+            // pairs with its release of the reference so its last events show.
+            const bool orphaned = it->use_count() == 1;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            const uint32_t tid = (*it)->thread_index() + 1;
+            if (trace_ && std::find(traced_threads_.begin(), traced_threads_.end(), tid) == traced_threads_.end()) {
+                traced_threads_.push_back(tid);
+                trace_->name_track(TraceWriter::kProbesPid, tid, "thread " + std::to_string(tid));
+            }
+            (*it)->drain([&](uint32_t site, uint64_t start, uint64_t ticks) {
+                if (site >= stats_.size()) {
+                    return;
+                }
+                const double ns = static_cast<double>(ticks) * ns_per_tick;
+                stats_[site].add(ns);
+                if (trace_) {
+                    const double offset = static_cast<double>(static_cast<int64_t>(start - anchor_tick_));
+                    trace_->complete(names_[site], TraceWriter::kProbesPid, tid, anchor_ns_ + offset * ns_per_tick, ns);
+                }
+            });
+            if (orphaned) {
+                retired_dropped_ += (*it)->dropped();
+                it = rings_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    static double probe_ns_per_tick() {
+#if defined(PERFLITE_HAS_TSC) || defined(PERFLITE_HAS_CNTVCT)
+        return CycleClock::ns_per_tick();
+#else
+        return 1.0;
+#endif
+    }
+
+    std::mutex mutex_;
+    std::vector<std::string> names_;
+    std::vector<OnlineStatistics> stats_;
+    std::vector<std::shared_ptr<detail::ProbeRing>> rings_;
+    uint64_t retired_dropped_ = 0;
+    uint32_t next_thread_ = 0;
+    const double anchor_ns_;
+    const uint64_t anchor_tick_;
+    TraceWriter* trace_ = nullptr;
+    std::vector<uint32_t> traced_threads_;
+    std::atomic<bool> stop_{false};
+    std::thread aggregator_;
+};
+
+// Times its own lifetime and records it under a probe site. Created by
+// PERFLITE_SCOPE rather than directly.
+class ScopedProbe {
+public:
+    explicit ScopedProbe(uint32_t site) : site_(site), start_(detail::probe_ticks()) {}
+    ~ScopedProbe() {
+        const uint64_t end = detail::probe_ticks();
+        ProbeRegistry::instance().ring().push(site_, start_, end - start_);
+    }
+    ScopedProbe(const ScopedProbe&) = delete;
+    ScopedProbe& operator=(const ScopedProbe&) = delete;
+
+private:
+    uint32_t site_;
+    uint64_t start_;
+};
+
+// Compile-time list of types for typed registration.
+template<typename... Ts>
+struct TypeList {};
+
+// Carries a type into a generic lambda: [](auto tag) { using T = typename decltype(tag)::type; }
+template<typename T>
+struct TypeTag {
+    using type = T;
+};
+
+namespace detail {
+
+template<typename T>
+const char* type_signature() {
+#if defined(_MSC_VER) && !defined(__clang__)
+    return __FUNCSIG__;
+#else
+    return __PRETTY_FUNCTION__;
+#endif
+}
+
+// Spelling of T as the compiler prints it, e.g. "std::vector<int>".
+template<typename T>
+std::string pretty_type_name() {
+    const std::string signature = type_signature<T>();
+#if defined(_MSC_VER) && !defined(__clang__)
+    // "const char *__cdecl PerfLite::detail::type_signature<int>(void)"
+    const std::string open = "type_signature<";
+    const size_t begin = signature.find(open);
+    const size_t end = signature.rfind(">(void)");
+    if (begin != std::string::npos && end != std::string::npos && end > begin + open.size()) {
+        return signature.substr(begin + open.size(), end - begin - open.size());
+    }
+#else
+    // GCC: "... [with T = int]", Clang: "... [T = int]"
+    const size_t begin = signature.find("T = ");
+    const size_t end = signature.rfind(']');
+    if (begin != std::string::npos && end != std::string::npos && end > begin + 4) {
+        return signature.substr(begin + 4, end - begin - 4);
+    }
+#endif
+    return typeid(T).name();
+}
+
+} // namespace detail
+
+// Name of a type in benchmark names. Specialize for shorter names:
+//
+//   template<> struct PerfLite::TypeName<std::unordered_map<int, int>> {
+//       static std::string get() { return "unordered_map"; }
+//   };
+template<typename T>
+struct TypeName {
+    static std::string get() { return detail::pretty_type_name<T>(); }
+};
+
+template<typename T>
+std::string type_name() {
+    return TypeName<T>::get();
+}
+
+// Configurations of a group of registered benchmarks, such as the
+// instantiations of a typed benchmark, adjusted together.
+class BenchmarkSet {
+public:
+    explicit BenchmarkSet(std::vector<Benchmark*> configs) : configs_(std::move(configs)) {}
+
+    // Applies `setter` to every configuration:
+    //   .each([](PerfLite::Benchmark& b) { b.unit(PerfLite::TimeUnit::Microseconds); })
+    template<typename Setter>
+    BenchmarkSet& each(Setter&& setter) {
+        for (Benchmark* config : configs_) {
+            setter(*config);
+        }
+        return *this;
+    }
+
+    size_t size() const { return configs_.size(); }
+
+private:
+    std::vector<Benchmark*> configs_;
+};
+
+// Failure of a registered benchmark, as thrown by run_registered(): names
+// the benchmark and keeps the original exception in `cause`.
+class BenchmarkError : public std::runtime_error {
+public:
+    BenchmarkError(const std::string& benchmark, const std::string& message, std::exception_ptr cause)
+        : std::runtime_error(message), benchmark_(benchmark), cause_(std::move(cause)) {}
+
+    const std::string& benchmark() const { return benchmark_; }
+    const std::exception_ptr& cause() const { return cause_; }
+
+private:
+    std::string benchmark_;
+    std::exception_ptr cause_;
+};
+
+// A benchmark in the global registry: its configuration and a runner that
+// invokes Benchmark::run with the concrete callable. The std::function is
+// only called once per run, never inside the timed loop.
+struct RegisteredBenchmark {
+    std::string name;
+    Benchmark config;
+    // One result, or one per range point for callables taking the input size.
+    std::function<std::vector<BenchmarkResult>(const Benchmark&)> runner;
+};
+
+// Process-wide list of benchmarks, filled by PERFLITE_BENCHMARK and
+// PERFLITE_REGISTER during static initialization.
+class Registry {
+public:
+    static Registry& instance() {
+        static Registry registry;
+        return registry;
+    }
+
+    // Registers a callable under `name` and returns its configuration so
+    // that it can be adjusted with the usual fluent setters. A callable
+    // taking a size_t is run over the configured range.
+    template<typename Func>
+    Benchmark& add(const std::string& name, Func func) {
+        auto entry = std::make_unique<RegisteredBenchmark>();
+        entry->name = name;
+        entry->config.name(name);
+        if constexpr (std::is_invocable_v<Func&>) {
+            entry->runner = [func](const Benchmark& config) mutable {
+                return std::vector<BenchmarkResult>{config.run(func)};
+            };
+        } else {
+            entry->runner = [func](const Benchmark& config) mutable { return config.run_range(func); };
+        }
+        entries_.push_back(std::move(entry));
+        return entries_.back()->config;
+    }
+
+    // Registers one benchmark per type of the TypeList, named
+    // "name<type>". `func` is a generic callable taking TypeTag<T> (and
+    // optionally the input size), so every instantiation is compiled
+    // separately and the timed loop has no runtime dispatch.
+    template<typename Types, typename Func>
+    BenchmarkSet add_typed(const std::string& name, Func func) {
+        return add_typed(name, func, Types{});
+    }
+
+    // Registers a fixture benchmark. The fixture F is built on the first run
+    // and reused by later runs and repetitions, so its constructor does the
+    // shared setup and its destructor the teardown; F::run() (or
+    // F::run(State&)) is the measured function and is called directly. Runs
+    // of one fixture are serialized, also under --jobs.
+    template<typename F>
+    Benchmark& add_fixture(const std::string& name) {
+        struct Slot {
+            std::mutex mutex;
+            std::unique_ptr<F> fixture;
+        };
+        auto slot = std::make_shared<Slot>();
+        auto entry = std::make_unique<RegisteredBenchmark>();
+        entry->name = name;
+        entry->config.name(name);
+        entry->runner = [slot](const Benchmark& config) {
+            std::lock_guard<std::mutex> lock(slot->mutex);
+            if (!slot->fixture) {
+                slot->fixture = std::make_unique<F>();
+            }
+            F& fixture = *slot->fixture;
+            if constexpr (std::is_invocable_v<decltype(&F::run), F&, State&>) {
+                return std::vector<BenchmarkResult>{config.run([&fixture](State& state) { fixture.run(state); })};
+            } else {
+                return std::vector<BenchmarkResult>{config.run([&fixture] { fixture.run(); })};
+            }
+        };
+        entries_.push_back(std::move(entry));
+        return entries_.back()->config;
+    }
+
+    // Registers the fixture benchmark Case<T> for every type of the
+    // TypeList, named "name<type>".
+    template<template<typename> class Case, typename Types>
+    BenchmarkSet add_typed_fixture(const std::string& name) {
+        return add_typed_fixture<Case>(name, Types{});
+    }
+
+    // All benchmarks in registration order.
+    const std::vector<std::unique_ptr<RegisteredBenchmark>>& benchmarks() const {
+        return entries_;
+    }
+
+    // Benchmarks whose name contains a match for `pattern` (ECMAScript regex),
+    // in registration order. Throws std::regex_error on an invalid pattern.
+    std::vector<const RegisteredBenchmark*> matching(const std::string& pattern) const {
+        const std::regex re(pattern);
+        std::vector<const RegisteredBenchmark*> found;
+        for (const auto& entry : entries_) {
+            if (std::regex_search(entry->name, re)) {
+                found.push_back(entry.get());
+            }
+        }
+        return found;
+    }
+
+    // Removes all registrations (mainly for tests).
+    void clear() {
+        entries_.clear();
+    }
+
+private:
+    Registry() = default;
+
+    template<typename Func, typename... Ts>
+    BenchmarkSet add_typed(const std::string& name, Func& func, TypeList<Ts...>) {
+        return BenchmarkSet({&add(name + "<" + type_name<Ts>() + ">",
+                                  [func](auto... args) -> decltype(func(TypeTag<Ts>{}, args...)) {
+                                      return func(TypeTag<Ts>{}, args...);
+                                  })...});
+    }
+
+    template<template<typename> class Case, typename... Ts>
+    BenchmarkSet add_typed_fixture(const std::string& name, TypeList<Ts...>) {
+        return BenchmarkSet({&add_fixture<Case<Ts>>(name + "<" + type_name<Ts>() + ">")...});
+    }
+
+    std::vector<std::unique_ptr<RegisteredBenchmark>> entries_;
+};
+
+// Command-line options understood by perflite_main().
+struct RunnerOptions {
+    std::string filter = ".*";
+    bool list = false;
+    bool help = false;
+    size_t repetitions = 0;                 // Runs per benchmark (0 = each benchmark's repetitions())
+    bool interleave = false;                // Rotate through benchmarks between repetitions
+    std::string format = "console";         // Report written to stdout: console, json or csv
+    std::string output;                     // File to also write the results to ("" = none)
+    std::string output_format = "json";     // Format of `output`: json or csv
+    std::string samples_output;             // Binary sample file to write ("" = none)
+    std::string trace;                      // Chrome trace of samples and probes to write ("" = none)
+    std::string baseline;                   // JSON report to compare against ("" = none)
+    std::string baseline_samples;           // Binary sample file of the baseline run ("" = none)
+    CompareOptions compare;
+    size_t jobs = 1;                        // Benchmarks run at once, one per physical core
+    bool check_interference = false;        // Rerun parallel benchmarks alone and flag slowdowns
+};
+
+// Parses perflite_main() flags: --filter=<regex>, --list, --repetitions=<n>,
+// --interleave, --jobs=<n>, --check-interference,
+// --format=<console|json|csv>, --output=<file>, --output-format=<json|csv>,
+// --samples-output=<file>, --trace=<file>, --baseline=<file>, --baseline-samples=<file>,
+// --threshold=<fraction>, --alpha=<level>, --help. Returns false and writes
+// a message to `err` on invalid input.
+inline bool parse_runner_options(int argc, char** argv, RunnerOptions& options, std::ostream& err = std::cerr) {
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value_of = [&arg](const std::string& flag, std::string& value) {
+            if (arg.compare(0, flag.size() + 1, flag + "=") == 0) {
+                value = arg.substr(flag.size() + 1);
+                return true;
+            }
+            return false;
+        };
+        std::string value;
+        if (arg == "--list") {
+            options.list = true;
+        } else if (arg == "--interleave") {
+            options.interleave = true;
+        } else if (arg == "--check-interference") {
+            options.check_interference = true;
+        } else if (arg == "--help" || arg == "-h") {
+            options.help = true;
+        } else if (value_of("--filter", value)) {
+            options.filter = value;
+        } else if (value_of("--repetitions", value)) {
+            char* end = nullptr;
+            const unsigned long long count = std::strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || count == 0) {
+                err << "Error: --repetitions expects a positive integer, got '" << value << "'\n";
+                return false;
+            }
+            options.repetitions = static_cast<size_t>(count);
+        } else if (value_of("--jobs", value)) {
+            char* end = nullptr;
+            const unsigned long long count = std::strtoull(value.c_str(), &end, 10);
+            if (value.empty() || *end != '\0' || count == 0) {
+                err << "Error: --jobs expects a positive integer, got '" << value << "'\n";
+                return false;
+            }
+            options.jobs = static_cast<size_t>(count);
+        } else if (value_of("--format", value)) {
+            if (value != "console" && value != "json" && value != "csv") {
+                err << "Error: --format expects console, json or csv, got '" << value << "'\n";
+                return false;
+            }
+            options.format = value;
+        } else if (value_of("--output", value)) {
+            options.output = value;
+        } else if (value_of("--output-format", value)) {
+            if (value != "json" && value != "csv") {
+                err << "Error: --output-format expects json or csv, got '" << value << "'\n";
+                return false;
+            }
+            options.output_format = value;
+        } else if (value_of("--samples-output", value)) {
+            options.samples_output = value;
+        } else if (value_of("--trace", value)) {
+            options.trace = value;
+        } else if (value_of("--baseline", value)) {
+            options.baseline = value;
+        } else if (value_of("--baseline-samples", value)) {
+            options.baseline_samples = value;
+        } else if (value_of("--threshold", value) || value_of("--alpha", value)) {
+            const bool is_alpha = arg.compare(0, 8, "--alpha=") == 0;
+            char* end = nullptr;
+            const double number = std::strtod(value.c_str(), &end);
+            if (value.empty() || *end != '\0' || number < 0.0 || (is_alpha && (number <= 0.0 || number >= 1.0))) {
+                err << "Error: " << (is_alpha ? "--alpha expects a level in (0, 1)" : "--threshold expects a non-negative fraction")
+                    << ", got '" << value << "'\n";
+                return false;
+            }
+            (is_alpha ? options.compare.alpha : options.compare.threshold) = number;
+        } else {
+            err << "Error: unknown option '" << arg << "' (see --help)\n";
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace detail {
+
+// Runs tasks 0..count-1 on one thread per CPU, each pinned to its CPU.
+// Tasks are dealt round-robin into per-worker deques; a worker takes its
+// own tasks from the front (registration order) and, once out of work,
+// steals from the back of another worker's deque, which balances long and
+// short benchmarks. `done(task)` is called on the worker after each task.
+template<typename RunTask, typename Done>
+void run_work_stealing(size_t count, const std::vector<int>& cpus, RunTask&& run_task, Done&& done) {
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+    std::vector<Queue> queues(cpus.size());
+    for (size_t task = 0; task < count; ++task) {
+        queues[task % queues.size()].tasks.push_back(task);
+    }
+    auto take = [&queues](size_t self, size_t& task) {
+        for (size_t k = 0; k < queues.size(); ++k) {
+            Queue& q = queues[(self + k) % queues.size()];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (!q.tasks.empty()) {
+                if (k == 0) {
+                    task = q.tasks.front();
+                    q.tasks.pop_front();
+                } else {
+                    task = q.tasks.back();
+                    q.tasks.pop_back();
+                }
+                return true;
+            }
+        }
+        return false;
+    };
+    std::vector<std::thread> pool;
+    pool.reserve(cpus.size());
+    for (size_t w = 0; w < cpus.size(); ++w) {
+        pool.emplace_back([&, w] {
+            pin_current_thread(cpus[w]);
+            size_t task = 0;
+            while (take(w, task)) {
+                run_task(task, cpus[w]);
+                done(task);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+} // namespace detail
+
+// Runs the registered benchmarks selected by `options`, printing each
+// result to `os` in console format, and returns the results in
+// registration order. Other formats are written by write_report().
+// Repeated benchmarks also print the spread of their per-run means; with
+// `interleave` every round runs all benchmarks once, so slow drift of the
+// machine spreads over all of them instead of biasing one.
+//
+// With `jobs` > 1, co-runnable benchmarks (see Benchmark::co_runnable())
+// run in parallel, one per physical core, and the rest run alone
+// afterwards; output keeps the serial order. `check_interference` then
+// reruns every parallel benchmark alone and reports those slowed down by
+// more than BenchmarkResult::kCoRunSensitivity.
+//
+// A benchmark that throws a std::exception stops the run with a
+// BenchmarkError naming it.
+inline std::vector<BenchmarkResult> run_registered(const RunnerOptions& options, std::ostream& os = std::cout) {
+    const std::vector<const RegisteredBenchmark*> entries = Registry::instance().matching(options.filter);
+    const bool console = options.format == "console";
+    auto repetitions_of = [&options](const RegisteredBenchmark* entry) {
+        return options.repetitions > 0 ? options.repetitions : entry->config.repetition_count();
+    };
+
+    // 1. One task per (benchmark, repetition), in the order a serial run uses
+    struct Task {
+        size_t entry;
+        size_t rep;
+        std::vector<BenchmarkResult> series;
+        std::exception_ptr error;
+    };
+    std::vector<Task> tasks;
+    if (options.interleave) {
+        size_t rounds = 0;
+        for (const RegisteredBenchmark* entry : entries) {
+            rounds = std::max(rounds, repetitions_of(entry));
+        }
+        for (size_t rep = 0; rep < rounds; ++rep) {
+            for (size_t i = 0; i < entries.size(); ++i) {
+                if (rep < repetitions_of(entries[i])) {
+                    tasks.push_back(Task{i, rep, {}, nullptr});
+                }
+            }
+        }
+    } else {
+        for (size_t i = 0; i < entries.size(); ++i) {
+            for (size_t rep = 0; rep < repetitions_of(entries[i]); ++rep) {
+                tasks.push_back(Task{i, rep, {}, nullptr});
+            }
+        }
+    }
+
+    auto execute = [&entries, &options](size_t entry, size_t rep, int cpu, size_t jobs) {
+        Benchmark config = entries[entry]->config;
+        if (cpu >= 0) {
+            config.pin_to_cpu(cpu);
+        }
+        if (!options.trace.empty()) {
+            config.record_timestamps();
+        }
+        std::vector<BenchmarkResult> series;
+        try {
+            series = entries[entry]->runner(config);
+        } catch (const std::exception& e) {
+            throw BenchmarkError(entries[entry]->name, e.what(), std::current_exception());
+        }
+        for (auto& r : series) {
+            r.repetition = rep;
+            r.jobs = jobs;
+        }
+        return series;
+    };
+    auto report = [&](const std::vector<BenchmarkResult>& series) {
+        if (!console) {
+            return;
+        }
+        for (const auto& r : series) {
+            r.print(os);
+        }
+        if (series.size() > 1) {
+            fit_complexity(series).print(os);
+        }
+    };
+
+    // 2. Split off the co-runnable tasks when running in parallel
+    std::vector<size_t> parallel;
+    std::vector<size_t> serial;
+    std::vector<int> cpus;
+    if (options.jobs > 1) {
+        cpus = detail::physical_core_cpus();
+        if (cpus.size() > options.jobs) {
+            cpus.resize(options.jobs);
+        }
+        if (cpus.size() < 2) {
+            std::cerr << "Warning: --jobs needs at least two physical cores; running serially\n";
+        }
+    }
+    for (size_t t = 0; t < tasks.size(); ++t) {
+        const bool co_run = cpus.size() > 1 && entries[tasks[t].entry]->config.co_runnable();
+        (co_run ? parallel : serial).push_back(t);
+    }
+
+    // 3. Parallel phase: results are printed in serial order as soon as
+    // every earlier task has finished
+    if (!parallel.empty()) {
+        std::vector<std::atomic<bool>> complete(parallel.size());
+        std::thread scheduler([&] {
+            detail::run_work_stealing(parallel.size(), cpus, [&](size_t k, int cpu) {
+                Task& task = tasks[parallel[k]];
+                try {
+                    task.series = execute(task.entry, task.rep, cpu, cpus.size());
+                } catch (...) {
+                    task.error = std::current_exception();
+                }
+            }, [&](size_t k) { complete[k].store(true, std::memory_order_release); });
+        });
+        std::exception_ptr error;
+        for (size_t k = 0; k < parallel.size(); ++k) {
+            // Coarse polling keeps this unpinned thread off the workers' cores
+            while (!complete[k].load(std::memory_order_acquire)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            Task& task = tasks[parallel[k]];
+            if (task.error) {
+                error = task.error;
+                break;
+            }
+            report(task.series);
+        }
+        scheduler.join();
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    // 4. Everything else runs alone
+    for (const size_t t : serial) {
+        tasks[t].series = execute(tasks[t].entry, tasks[t].rep, -1, 1);
+        report(tasks[t].series);
+    }
+
+    // 5. Optional interference check: first repetition against a solo rerun
+    if (options.check_interference && !parallel.empty()) {
+        for (const size_t t : parallel) {
+            Task& task = tasks[t];
+            if (task.rep != 0) {
+                continue;
+            }
+            const std::vector<BenchmarkResult> solo = execute(task.entry, 0, cpus.front(), 1);
+            for (size_t p = 0; p < task.series.size() && p < solo.size(); ++p) {
+                BenchmarkResult& r = task.series[p];
+                r.co_run_slowdown = (solo[p].mean_time > 0.0) ? r.mean_time / solo[p].mean_time - 1.0 : 0.0;
+                if (r.co_run_slowdown > BenchmarkResult::kCoRunSensitivity) {
+                    std::ostringstream percent;
+                    percent << std::fixed << std::setprecision(1) << r.co_run_slowdown * 100.0;
+                    std::cerr << "Warning: '" << r.name << "' is " << percent.str()
+                              << "% slower next to other benchmarks; it is likely memory-bandwidth bound"
+                              << " (run it with --jobs=1)\n";
+                }
+            }
+        }
+    }
+
+    std::vector<std::vector<BenchmarkResult>> per_entry(entries.size());
+    for (const Task& task : tasks) {
+        per_entry[task.entry].insert(per_entry[task.entry].end(), task.series.begin(), task.series.end());
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (console && repetitions_of(entries[i]) > 1) {
+            // Range benchmarks repeat every point; summarize each separately
+            std::vector<std::string> names;
+            for (const auto& r : per_entry[i]) {
+                if (std::find(names.begin(), names.end(), r.name) == names.end()) {
+                    names.push_back(r.name);
+                }
+            }
+            for (const auto& point : names) {
+                std::vector<BenchmarkResult> runs;
+                std::copy_if(per_entry[i].begin(), per_entry[i].end(), std::back_inserter(runs),
+                             [&point](const BenchmarkResult& r) { return r.name == point; });
+                aggregate_repetitions(std::move(runs)).print(os);
+            }
+        }
+        results.insert(results.end(), per_entry[i].begin(), per_entry[i].end());
+    }
+    return results;
+}
+
+// Writes the non-console reports requested by `options`: JSON/CSV on `os`,
+// the --output file and the --samples-output file. Returns false if a file
+// could not be written.
+inline bool write_report(const RunnerOptions& options, const std::vector<BenchmarkResult>& results,
+                         std::ostream& os = std::cout) {
+    if (options.format == "json") {
+        write_json(os, results);
+    } else if (options.format == "csv") {
+        write_csv(os, results);
+    }
+    bool ok = true;
+    if (!options.output.empty()) {
+        std::ofstream file(options.output);
+        if (options.output_format == "csv") {
+            write_csv(file, results);
+        } else {
+            write_json(file, results);
+        }
+        if (!file) {
+            std::cerr << "Error: could not write '" << options.output << "'\n";
+            ok = false;
+        }
+    }
+    if (!options.samples_output.empty()) {
+        std::ofstream file(options.samples_output, std::ios::binary);
+        if (!write_samples(file, results)) {
+            std::cerr << "Error: could not write '" << options.samples_output << "'\n";
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// Compares `results` with the --baseline report (and --baseline-samples),
+// printing one line block per benchmark. Returns 0, 1 if the baseline could
+// not be loaded, or 2 if any benchmark regressed.
+inline int compare_with_baseline(const RunnerOptions& options, const std::vector<BenchmarkResult>& results,
+                                 std::ostream& os = std::cout) {
+    std::vector<BaselineEntry> baseline;
+    std::ifstream json(options.baseline);
+    if (!json) {
+        std::cerr << "Error: could not open baseline '" << options.baseline << "'\n";
+        return 1;
+    }
+    if (!read_baseline_json(json, baseline)) {
+        return 1;
+    }
+    if (!options.baseline_samples.empty()) {
+        std::ifstream file(options.baseline_samples, std::ios::binary);
+        std::vector<SampleSet> sets;
+        if (!file || !read_samples(file, sets)) {
+            std::cerr << "Error: could not read baseline samples '" << options.baseline_samples << "'\n";
+            return 1;
+        }
+        attach_baseline_samples(baseline, sets);
+    }
+    bool regressed = false;
+    for (const auto& c : compare(baseline, results, options.compare)) {
+        c.print(os);
+        regressed = regressed || c.regression;
+    }
+    return regressed ? 2 : 0;
+}
+
+// Entry point for benchmark binaries built from registered benchmarks.
+// Returns the process exit code (2 when a baseline comparison regressed).
+inline int perflite_main(int argc, char** argv) {
+    RunnerOptions options;
+    if (!parse_runner_options(argc, argv, options)) {
+        return 1;
+    }
+    if (options.help) {
+        std::cout << "Usage: " << (argc > 0 ? argv[0] : "perflite") << " [options]\n"
+                  << "  --list               List registered benchmarks and exit\n"
+                  << "  --filter=<regex>     Run only benchmarks whose name matches\n"
+                  << "  --repetitions=<n>    Run each selected benchmark n times (default: its repetitions())\n"
+                  << "  --interleave         Alternate between benchmarks from one repetition to the next\n"
+                  << "  --jobs=<n>           Run up to n single-threaded benchmarks at once, one per physical core\n"
+                  << "  --check-interference Rerun parallel benchmarks alone and flag co-running slowdowns\n"
+                  << "  --format=<fmt>       stdout report: console (default), json or csv\n"
+                  << "  --output=<file>      Also write results to a file\n"
+                  << "  --output-format=<f>  Format of --output: json (default) or csv\n"
+                  << "  --samples-output=<f> Write raw samples to a binary file\n"
+                  << "  --trace=<file>       Write samples and probes as a Chrome trace (JSON)\n"
+                  << "  --baseline=<file>    Compare against a previous JSON report\n"
+                  << "  --baseline-samples=<f> Binary samples of the baseline (enables Mann-Whitney U)\n"
+                  << "  --threshold=<frac>   Relative slowdown treated as a regression (default 0.05)\n"
+                  << "  --alpha=<level>      Significance level (default 0.05)\n"
+                  << "  --help               Show this message\n";
+        return 0;
+    }
+    std::ofstream trace_file;
+    std::unique_ptr<TraceWriter> trace;
+    auto stop_tracing = [&trace] {
+        if (trace) {
+            ProbeRegistry::instance().stop_aggregator();
+            ProbeRegistry::instance().trace_to(nullptr);
+        }
+    };
+    try {
+        if (options.list) {
+            for (const RegisteredBenchmark* entry : Registry::instance().matching(options.filter)) {
+                std::cout << entry->name << "\n";
+            }
+            return 0;
+        }
+        if (!options.trace.empty()) {
+            trace_file.open(options.trace);
+            if (!trace_file) {
+                std::cerr << "Error: could not write '" << options.trace << "'\n";
+                return 1;
+            }
+            trace = std::make_unique<TraceWriter>(trace_file);
+            ProbeRegistry::instance().trace_to(trace.get());
+            ProbeRegistry::instance().start_aggregator();
+        }
+        const std::vector<BenchmarkResult> results = run_registered(options);
+        if (trace) {
+            stop_tracing();
+            for (const auto& r : results) {
+                trace->add_samples(r);
+            }
+            trace->close();
+        }
+        if (!write_report(options, results)) {
+            return 1;
+        }
+        if (!options.baseline.empty()) {
+            // Keep stdout parseable when it carries a JSON or CSV report
+            return compare_with_baseline(options, results, options.format == "console" ? std::cout : std::cerr);
+        }
+    } catch (const std::regex_error& e) {
+        std::cerr << "Error: invalid --filter pattern '" << options.filter << "': " << e.what() << "\n";
+        return 1;
+    } catch (const BenchmarkError& e) {
+        stop_tracing();
+        std::cerr << "Error: " << e.benchmark() << ": " << e.what() << "\n";
+        return 1;
+    } catch (const std::exception& e) {
+        stop_tracing();
+        std::cerr << "Error: " << e.what() << "\n";
+        return 1;
+    }
+    return 0;
+}
+
+} // namespace PerfLite
+
+#define PERFLITE_CONCAT_IMPL(a, b) a##b
+#define PERFLITE_CONCAT(a, b) PERFLITE_CONCAT_IMPL(a, b)
+#if defined(__COUNTER__)
+#define PERFLITE_UNIQUE_NAME(prefix) PERFLITE_CONCAT(prefix, __COUNTER__)
+#else
+#define PERFLITE_UNIQUE_NAME(prefix) PERFLITE_CONCAT(prefix, __LINE__)
+#endif
+
+// Defines and registers a benchmark whose body is the measured function:
+//
+//   PERFLITE_BENCHMARK(vector_push_back) {
+//       std::vector<int> v;
+//       v.push_back(1);
+//       PerfLite::DoNotOptimize(v);
+//   }
+#define PERFLITE_BENCHMARK(bench_name)                                                          \
+    static void bench_name();                                                                   \
+    [[maybe_unused]] static ::PerfLite::Benchmark& PERFLITE_CONCAT(perflite_registration_, bench_name) = \
+        ::PerfLite::Registry::instance().add(#bench_name, [] { bench_name(); });                \
+    static void bench_name()
+
+// Registers an existing function; the configuration can be chained.
+// Functions taking a size_t are run over the range and fitted for Big-O:
+//
+//   PERFLITE_REGISTER(parse_header).unit(PerfLite::TimeUnit::Microseconds);
+//   PERFLITE_REGISTER(sort_n).range(8, 1 << 20).multiplier(4);
+#define PERFLITE_REGISTER(func)                                                                 \
+    [[maybe_unused]] static ::PerfLite::Benchmark& PERFLITE_UNIQUE_NAME(perflite_registration_) = \
+        ::PerfLite::Registry::instance().add(#func, [](auto... args) -> decltype(func(args...)) { \
+            return func(args...);                                                               \
+        })
+
+// Times the rest of the enclosing scope and records it under `probe_name`,
+// for instrumenting real code paths; read the statistics with
+// ProbeRegistry::instance().results(). At most one probe per source line.
+// Defining PERFLITE_DISABLE_PROBES compiles every probe out.
+//
+//   void handle_request(Request& r) {
+//       PERFLITE_SCOPE("handle_request");
+//       ...
+//   }
+#if defined(PERFLITE_DISABLE_PROBES)
+#define PERFLITE_SCOPE(probe_name) static_cast<void>(0)
+#else
+#define PERFLITE_SCOPE(probe_name)                                                              \
+    static const uint32_t PERFLITE_CONCAT(perflite_probe_site_, __LINE__) =                     \
+        ::PerfLite::ProbeRegistry::instance().site(probe_name);                                 \
+    const ::PerfLite::ScopedProbe PERFLITE_CONCAT(perflite_probe_, __LINE__)(                   \
+        PERFLITE_CONCAT(perflite_probe_site_, __LINE__))
+#endif
+
+// Registers a function template once per listed type, as "func<type>":
+//
+//   template<typename Map> void map_insert() { Map m; m.emplace(1, 2); PerfLite::DoNotOptimize(m); }
+//   PERFLITE_REGISTER_TEMPLATE(map_insert, std::map<int, int>, std::unordered_map<int, int>);
+#define PERFLITE_REGISTER_TEMPLATE(func, ...)                                                   \
+    [[maybe_unused]] static ::PerfLite::BenchmarkSet PERFLITE_UNIQUE_NAME(perflite_registration_) = \
+        ::PerfLite::Registry::instance().add_typed<::PerfLite::TypeList<__VA_ARGS__>>(          \
+            #func, [](auto tag, auto... args) -> decltype(func<typename decltype(tag)::type>(args...)) { \
+                return func<typename decltype(tag)::type>(args...);                             \
+            })
+
+// Defines a benchmark on a fixture class, registered as "Fixture/name". The
+// body is a member of a class derived from the fixture, so it sees the
+// fixture's members; the fixture is set up once and reused across runs:
+//
+//   struct SortedInput { std::vector<int> data = make_sorted(1 << 16); };
+//   PERFLITE_FIXTURE(SortedInput, binary_search) {
+//       PerfLite::DoNotOptimize(std::binary_search(data.begin(), data.end(), 42));
+//   }
+#define PERFLITE_FIXTURE(fixture, bench_name)                                                   \
+    struct fixture##_##bench_name##_Benchmark : fixture {                                       \
+        void run();                                                                             \
+    };                                                                                          \
+    [[maybe_unused]] static ::PerfLite::Benchmark& PERFLITE_CONCAT(perflite_registration_, fixture##_##bench_name) = \
+        ::PerfLite::Registry::instance().add_fixture<fixture##_##bench_name##_Benchmark>(#fixture "/" #bench_name); \
+    void fixture##_##bench_name##_Benchmark::run()
+
+// Defines a benchmark on a fixture class template, instantiated and
+// registered once per listed type as "Fixture/name<type>". Inside the body
+// the type is `T` and fixture members are reached through `this->`:
+//
+//   template<typename Map> struct Filled { Map map = make_filled<Map>(1000); };
+//   PERFLITE_TYPED_FIXTURE(Filled, find, std::map<int, int>, std::unordered_map<int, int>) {
+//       PerfLite::DoNotOptimize(this->map.find(500));
+//   }
+#define PERFLITE_TYPED_FIXTURE(fixture, bench_name, ...)                                        \
+    template<typename T>                                                                        \
+    struct fixture##_##bench_name##_Benchmark : fixture<T> {                                    \
+        void run();                                                                             \
+    };                                                                                          \
+    [[maybe_unused]] static ::PerfLite::BenchmarkSet PERFLITE_CONCAT(perflite_registration_, fixture##_##bench_name) = \
+        ::PerfLite::Registry::instance().add_typed_fixture<fixture##_##bench_name##_Benchmark,  \
+                                                           ::PerfLite::TypeList<__VA_ARGS__>>(#fixture "/" #bench_name); \
+    template<typename T>                                                                        \
+    void fixture##_##bench_name##_Benchmark<T>::run()
+
+// Defines main() as perflite_main().
+#define PERFLITE_MAIN()                                 \
+    int main(int argc, char** argv) {                   \
+        return ::PerfLite::perflite_main(argc, argv);   \
+    }
+
+// Replacement global operator new/delete feeding AllocationCounters. Define
+// PERFLITE_TRACK_ALLOCATIONS in exactly one translation unit before
+// including perf_lite.h. Every block carries a small header with its size
+// so that deletes can be attributed without relying on sized delete.
+#if defined(PERFLITE_TRACK_ALLOCATIONS) && !defined(PERFLITE_ALLOCATION_HOOKS_DEFINED)
+#define PERFLITE_ALLOCATION_HOOKS_DEFINED
+#include <new>
+
+namespace PerfLite {
+namespace detail {
+
+struct AllocationHeader {
+    size_t size;
+    void* raw;
+};
+
+inline void* tracked_allocate(size_t size, size_t alignment) {
+    alignment = std::max(alignment, alignof(AllocationHeader));
+    // The padded request must not wrap around to a small block.
+    if (size > SIZE_MAX - sizeof(AllocationHeader) - alignment + 1) {
+        return nullptr;
+    }
+    for (;;) {
+        void* raw = std::malloc(size + sizeof(AllocationHeader) + alignment - 1);
+        if (raw) {
+            const uintptr_t base = reinterpret_cast<uintptr_t>(raw) + sizeof(AllocationHeader);
+            void* user = reinterpret_cast<void*>((base + alignment - 1) & ~(uintptr_t(alignment) - 1));
+            AllocationHeader* header = static_cast<AllocationHeader*>(user) - 1;
+            header->size = size;
+            header->raw = raw;
+            AllocationCounters::on_allocate(size);
+            return user;
+        }
+        std::new_handler handler = std::get_new_handler();
+        if (!handler) {
+            return nullptr;
+        }
+        handler();
+    }
+}
+
+inline void tracked_free(void* ptr) {
+    if (!ptr) {
+        return;
+    }
+    AllocationHeader* header = static_cast<AllocationHeader*>(ptr) - 1;
+    AllocationCounters::on_deallocate(header->size);
+    std::free(header->raw);
+}
+
+inline void* tracked_allocate_or_throw(size_t size, size_t alignment) {
+    void* ptr = tracked_allocate(size, alignment);
+    if (!ptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+static const bool allocation_hooks_installed = (AllocationCounters::installed.store(true), true);
+
+} // namespace detail
+} // namespace PerfLite
+
+void* operator new(std::size_t size) {
+    return PerfLite::detail::tracked_allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new[](std::size_t size) {
+    return PerfLite::detail::tracked_allocate_or_throw(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return PerfLite::detail::tracked_allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return PerfLite::detail::tracked_allocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return PerfLite::detail::tracked_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return PerfLite::detail::tracked_allocate_or_throw(size, static_cast<std::size_t>(alignment));
+}
+void* operator new(std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return PerfLite::detail::tracked_allocate(size, static_cast<std::size_t>(alignment));
+}
+void* operator new[](std::size_t size, std::align_val_t alignment, const std::nothrow_t&) noexcept {
+    return PerfLite::detail::tracked_allocate(size, static_cast<std::size_t>(alignment));
+}
+void operator delete(void* ptr) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { PerfLite::detail::tracked_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { PerfLite::detail::tracked_free(ptr); }
+
+#endif // PERFLITE_TRACK_ALLOCATIONS
 
 #endif // PERF_LITE_H
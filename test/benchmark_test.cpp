@@ -1,6 +1,7 @@
 #include <gtest/gtest.h>
 #include "../perf_lite.h"
 #include <stdexcept>
+#include <cstring>
 
 // Test that benchmark can be created and run
 TEST(BenchmarkTest, CanCreateAndRun) {
@@ -141,3 +142,299 @@ TEST(BenchmarkTest, TimeUnitOrdering) {
     EXPECT_GT(mean_us, mean_ms);
     EXPECT_GT(mean_ms, mean_s);
 }
+
+// Batched mode: tiny functions are timed in blocks, so far fewer samples are recorded
+TEST(BenchmarkTest, BatchedModeGroupsCalls) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.batched().run([]() -> int { return 42; });
+
+    EXPECT_GT(result.batch_size, 1u);
+    EXPECT_EQ(result.durations.size() * result.batch_size, result.iterations);
+    EXPECT_GT(result.mean_time, 0.0);
+}
+
+// Explicit batch size is honoured exactly
+TEST(BenchmarkTest, ExplicitBatchSize) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.batch_size(50).run([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    EXPECT_EQ(result.batch_size, 50u);
+    EXPECT_EQ(result.durations.size() * 50u, result.iterations);
+}
+
+// Overhead calibration: the harness cost is measured and reported with the result
+TEST(BenchmarkTest, SubtractOverheadReportsOverhead) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.batched().subtract_overhead().run([]() -> int { return 42; });
+
+    EXPECT_TRUE(result.subtract_overhead);
+    EXPECT_GE(result.overhead_ns, 0.0);
+    EXPECT_GE(result.mean_time, 0.0);
+    EXPECT_GE(result.min_time, 0.0);
+}
+
+// Cycle-counter clock produces times comparable to the chrono clock, plus cycles
+TEST(BenchmarkTest, CycleCounterClock) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.clock(PerfLite::ClockSource::CycleCounter).run([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    EXPECT_FALSE(result.durations.empty());
+    EXPECT_GT(result.mean_time, 0.0);
+    if (PerfLite::CycleClock::counts_cycles) {
+        EXPECT_EQ(result.clock, PerfLite::ClockSource::CycleCounter);
+        EXPECT_GT(result.cycles_per_ns, 0.0);
+        EXPECT_GT(result.mean_cycles, 0.0);
+    }
+}
+
+// Streaming mode keeps no per-sample storage but still reports statistics
+TEST(BenchmarkTest, StreamingModeStoresNoSamples) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.streaming().run([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    EXPECT_TRUE(result.durations.empty());
+    EXPECT_GT(result.sample_count, 0u);
+    EXPECT_EQ(result.online.count, result.sample_count);
+    EXPECT_GT(result.mean_time, 0.0);
+    EXPECT_GE(result.stddev_time, 0.0);
+}
+
+// Tail statistics are ordered for both raw and streaming samples
+TEST(BenchmarkTest, PercentilesAreOrdered) {
+    for (bool streaming : {false, true}) {
+        PerfLite::Benchmark benchmark;
+        auto result = benchmark.streaming(streaming).percentiles({50.0, 99.0}).run([]() {
+            volatile int x = 0;
+            x += 1;
+        });
+
+        EXPECT_LE(result.min_time, result.median_time);
+        EXPECT_LE(result.percentile(50.0), result.percentile(99.0));
+        EXPECT_LE(result.percentile(99.0), result.max_time);
+        EXPECT_FALSE(result.histogram.empty());
+    }
+}
+
+// Hardware counters are optional: when the PMU is accessible they are reported per iteration
+TEST(BenchmarkTest, HardwareCountersWhenAvailable) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.hardware_counters().run([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    EXPECT_GT(result.mean_time, 0.0);
+    if (PerfLite::PerfCounters().available()) {
+        EXPECT_FALSE(result.counters.empty());
+        for (const auto& c : result.counters) {
+            EXPECT_GE(c.per_iteration, 0.0);
+        }
+    } else {
+        EXPECT_TRUE(result.counters.empty());
+        EXPECT_EQ(result.ipc, 0.0);
+    }
+}
+
+// Multi-threaded run reports per-thread and aggregate throughput
+TEST(BenchmarkTest, ThreadsReportPerThreadThroughput) {
+    PerfLite::Benchmark benchmark;
+    std::atomic<int> counter{0};
+    auto result = benchmark.threads(2).target_duration(std::chrono::milliseconds(20)).run([&counter]() {
+        counter.fetch_add(1, std::memory_order_relaxed);
+    });
+
+    EXPECT_EQ(result.threads, 2u);
+    ASSERT_EQ(result.thread_ops_per_sec.size(), 2u);
+    EXPECT_GT(result.aggregate_ops_per_sec, 0.0);
+    EXPECT_NEAR(result.aggregate_ops_per_sec, result.thread_ops_per_sec[0] + result.thread_ops_per_sec[1], 1e-6);
+    EXPECT_EQ(result.durations.size() * result.batch_size, result.iterations);
+}
+
+// Thread sweep starts at one thread with efficiency 1 by definition
+TEST(BenchmarkTest, ScalingSweep) {
+    PerfLite::Benchmark benchmark;
+    auto results = benchmark.target_duration(std::chrono::milliseconds(10)).run_scaling([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    ASSERT_FALSE(results.empty());
+    EXPECT_EQ(results.front().threads, 1u);
+    EXPECT_NEAR(results.front().scaling_efficiency, 1.0, 1e-12);
+    EXPECT_EQ(results.back().threads, std::max(1u, std::thread::hardware_concurrency()));
+}
+
+// Exceptions thrown on worker threads are rethrown to the caller
+TEST(BenchmarkTest, ThreadsPropagateExceptions) {
+    PerfLite::Benchmark benchmark;
+    std::atomic<int> calls{0};
+    EXPECT_THROW(
+        benchmark.threads(2).run([&calls]() {
+            // Let warmup and calibration pass, then fail inside the timed loop
+            if (calls.fetch_add(1) > 2000) throw std::runtime_error("boom");
+        }),
+        std::runtime_error
+    );
+}
+
+// Pinning to an allowed CPU is recorded in the result environment
+TEST(BenchmarkTest, PinToCpuRecordsEnvironment) {
+    const auto cpus = PerfLite::detail::allowed_cpus();
+    if (cpus.empty()) {
+        GTEST_SKIP() << "CPU affinity not supported on this platform";
+    }
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.pin_to_cpu(cpus.front()).target_duration(std::chrono::milliseconds(10)).run([]() {
+        volatile int x = 0;
+        x += 1;
+    });
+
+    EXPECT_EQ(result.environment.pinned_cpu, cpus.front());
+    EXPECT_GT(result.environment.logical_cpus, 0u);
+    // The original affinity is restored after the run
+    EXPECT_EQ(PerfLite::detail::allowed_cpus(), cpus);
+}
+
+// Range benchmarks produce one named result per input size
+TEST(BenchmarkTest, RunRangePassesSizes) {
+    PerfLite::Benchmark benchmark;
+    std::vector<size_t> seen;
+    auto results = benchmark.name("fill").range(16, 256).multiplier(4)
+        .target_duration(std::chrono::milliseconds(5))
+        .run_range([&seen](size_t n) {
+            if (seen.empty() || seen.back() != n) seen.push_back(n);
+            std::vector<int> v(n, 1);
+            PerfLite::DoNotOptimize(v);
+        });
+
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(results[0].name, "fill/16");
+    EXPECT_EQ(results[2].complexity_n, 256u);
+    EXPECT_EQ(seen, (std::vector<size_t>{16, 64, 256}));
+    auto fit = PerfLite::fit_complexity(results);
+    EXPECT_GE(fit.rms, 0.0);
+}
+
+// State benchmarks: per-iteration setup stays out of the samples
+TEST(BenchmarkTest, StateSetupIsNotTimed) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.target_duration(std::chrono::milliseconds(20)).run([](PerfLite::State& state) {
+        for (auto _ : state) {
+            state.pause_timing();
+            std::this_thread::sleep_for(std::chrono::microseconds(20));
+            state.resume_timing();
+            volatile int x = 0;
+            x += 1;
+        }
+    });
+
+    EXPECT_FALSE(result.durations.empty());
+    EXPECT_GT(result.mean_time, 0.0);
+    // The 20us sleep is paused, so the typical sample is well below it
+    EXPECT_LT(result.median_time, 20000.0);
+}
+
+TEST(BenchmarkTest, AdaptiveStoppingReachesTarget) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.confidence_target(0.05).max_time(std::chrono::seconds(5)).run([] {
+        volatile int x = 0;
+        for (int i = 0; i < 50; ++i) {
+            x = x + 1;
+        }
+    });
+
+    EXPECT_TRUE(result.converged);
+    EXPECT_LE(result.confidence_half_width, 0.05);
+    EXPECT_EQ(result.sample_count, result.durations.size());
+    EXPECT_GE(result.sample_count, 30u);
+}
+
+TEST(BenchmarkTest, AdaptiveStoppingHonorsMaxTime) {
+    PerfLite::Benchmark benchmark;
+    const auto start = std::chrono::steady_clock::now();
+    auto result = benchmark.confidence_target(1e-12, PerfLite::StopStatistic::Median)
+                      .max_time(std::chrono::milliseconds(50))
+                      .run([] {
+                          volatile int x = 0;
+                          x += 1;
+                      });
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    EXPECT_FALSE(result.converged);
+    EXPECT_GT(result.confidence_half_width, 1e-12);
+    // Calibration plus one chunk past the budget, far below a fixed 1M-sample run
+    EXPECT_LT(elapsed, std::chrono::seconds(3));
+}
+
+TEST(BenchmarkTest, BytesProcessedFromState) {
+    std::vector<char> src(4096, 'a');
+    std::vector<char> dst(4096);
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.target_duration(std::chrono::milliseconds(20)).run([&](PerfLite::State& state) {
+        for (auto _ : state) {
+            std::memcpy(dst.data(), src.data(), src.size());
+            PerfLite::DoNotOptimize(dst);
+        }
+        state.set_bytes_processed(state.iterations() * src.size());
+    });
+
+    EXPECT_DOUBLE_EQ(result.bytes_per_iteration, 4096.0);
+    EXPECT_GT(result.bytes_per_sec, 0.0);
+    EXPECT_DOUBLE_EQ(result.bytes_per_sec, 4096.0 * result.ops_per_sec);
+}
+
+TEST(BenchmarkTest, ItemsPerIterationConfig) {
+    PerfLite::Benchmark benchmark;
+    auto result = benchmark.target_duration(std::chrono::milliseconds(10)).items_per_iteration(8).run([] {
+        volatile int x = 0;
+        x += 1;
+    });
+    EXPECT_DOUBLE_EQ(result.items_per_iteration, 8.0);
+    EXPECT_NEAR(result.items_per_sec, 8.0 * result.ops_per_sec, 1e-6 * result.items_per_sec);
+}
+
+TEST(BenchmarkTest, ColdCacheIsSlowerThanWarm) {
+    std::vector<uint64_t> data(1 << 15, 1);  // 256 KB, fits in L2 when warm
+    auto sum = [&data] {
+        uint64_t total = 0;
+        for (size_t i = 0; i < data.size(); i += 8) {
+            total += data[i];
+        }
+        PerfLite::DoNotOptimize(total);
+    };
+
+    PerfLite::Benchmark warm;
+    auto warm_result = warm.target_duration(std::chrono::milliseconds(20)).run(sum);
+    PerfLite::Benchmark cold;
+    auto cold_result = cold.target_duration(std::chrono::milliseconds(20))
+                           .cache_mode(PerfLite::CacheMode::Cold)
+                           .cache_flush_buffer(data.data(), data.size() * sizeof(uint64_t))
+                           .run(sum);
+
+    EXPECT_EQ(cold_result.cache_mode, PerfLite::CacheMode::Cold);
+    EXPECT_EQ(cold_result.batch_size, 1u);
+    EXPECT_GE(cold_result.sample_count, 50u);
+    EXPECT_GT(cold_result.median_time, warm_result.median_time);
+}
+
+TEST(BenchmarkTest, ScopeProbeIsCheap) {
+    // The background aggregator keeps the ring from filling, so every probe
+    // takes the recording path rather than the drop path.
+    auto& probes = PerfLite::ProbeRegistry::instance();
+    probes.start_aggregator(std::chrono::milliseconds(1));
+    auto probed = PerfLite::Benchmark().target_duration(std::chrono::milliseconds(20)).run([] {
+        PERFLITE_SCOPE("benchmark.probe");
+    });
+    probes.stop_aggregator();
+    auto empty = PerfLite::Benchmark().target_duration(std::chrono::milliseconds(20)).run([] {});
+    EXPECT_LT(probed.median_time - empty.median_time, 500.0);
+}
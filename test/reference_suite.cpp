@@ -0,0 +1,335 @@
+// Reference suite: memory latency and bandwidth of this machine across
+// working-set sizes, measured with PerfLite itself. The numbers give a
+// roofline for judging the kernels benchmarked elsewhere.
+//
+//   perf_lite_reference                        # full sweep, 4 KB .. 256 MB
+//   perf_lite_reference --filter='^copy'       # one kernel
+//   perf_lite_reference --format=json > machine.json
+//
+// Latency is a dependent pointer chase through one cache line per node in
+// random order (so hardware prefetchers cannot help); bandwidth kernels
+// stream 64 KB per call through the working set, so every call is short
+// while the whole set is still cycled through the caches.
+
+#include "../perf_lite.h"
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#define REFERENCE_HAS_SSE2 1
+#if defined(__GNUC__) && !defined(_MSC_VER)
+#define REFERENCE_HAS_AVX2 1
+#endif
+#endif
+
+namespace {
+
+constexpr size_t kLine = 64;
+constexpr size_t kChunk = 64 * 1024;  // Bytes streamed per bandwidth call
+constexpr size_t kChaseLoads = 256;   // Dependent loads per latency call
+constexpr size_t kMinWorkingSet = 4 * 1024;
+constexpr size_t kMaxWorkingSet = 256 * 1024 * 1024;
+
+// Cache-line aligned, pre-faulted scratch memory.
+class AlignedBuffer {
+public:
+    explicit AlignedBuffer(size_t bytes)
+        : data_(static_cast<char*>(::operator new(bytes, std::align_val_t(kLine)))), size_(bytes) {
+        std::memset(data_, 1, size_);
+    }
+    ~AlignedBuffer() { ::operator delete(data_, std::align_val_t(kLine)); }
+
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+
+    char* data() { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    char* data_;
+    size_t size_;
+};
+
+// Bandwidth kernels over [p, p + bytes); bytes is a multiple of kLine.
+using ReadKernel = uint64_t (*)(const char* p, size_t bytes);
+using WriteKernel = void (*)(char* p, size_t bytes);
+using CopyKernel = void (*)(char* dst, const char* src, size_t bytes);
+
+#if !REFERENCE_HAS_SSE2
+// Portable fallbacks, selected only where SSE2 is unavailable.
+uint64_t read_scalar(const char* p, size_t bytes) {
+    const uint64_t* words = reinterpret_cast<const uint64_t*>(p);
+    uint64_t acc = 0;
+    for (size_t i = 0; i < bytes / sizeof(uint64_t); ++i) {
+        acc |= words[i];
+    }
+    return acc;
+}
+
+void write_scalar(char* p, size_t bytes) {
+    uint64_t* words = reinterpret_cast<uint64_t*>(p);
+    for (size_t i = 0; i < bytes / sizeof(uint64_t); ++i) {
+        words[i] = i;
+    }
+}
+
+void copy_scalar(char* dst, const char* src, size_t bytes) {
+    std::memcpy(dst, src, bytes);
+}
+#endif
+
+#if REFERENCE_HAS_SSE2
+uint64_t read_sse2(const char* p, size_t bytes) {
+    __m128i a = _mm_setzero_si128(), b = a, c = a, d = a;
+    for (size_t i = 0; i < bytes; i += kLine) {
+        a = _mm_or_si128(a, _mm_load_si128(reinterpret_cast<const __m128i*>(p + i)));
+        b = _mm_or_si128(b, _mm_load_si128(reinterpret_cast<const __m128i*>(p + i + 16)));
+        c = _mm_or_si128(c, _mm_load_si128(reinterpret_cast<const __m128i*>(p + i + 32)));
+        d = _mm_or_si128(d, _mm_load_si128(reinterpret_cast<const __m128i*>(p + i + 48)));
+    }
+    const __m128i all = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(all));
+}
+
+void write_sse2(char* p, size_t bytes) {
+    const __m128i v = _mm_set1_epi32(0x5a5a5a5a);
+    for (size_t i = 0; i < bytes; i += 16) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(p + i), v);
+    }
+}
+
+// Non-temporal stores bypass the caches; the fence orders them before the
+// next call reads the clock.
+void write_nt_sse2(char* p, size_t bytes) {
+    const __m128i v = _mm_set1_epi32(0x5a5a5a5a);
+    for (size_t i = 0; i < bytes; i += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(p + i), v);
+    }
+    _mm_sfence();
+}
+
+void copy_sse2(char* dst, const char* src, size_t bytes) {
+    for (size_t i = 0; i < bytes; i += 16) {
+        _mm_store_si128(reinterpret_cast<__m128i*>(dst + i), _mm_load_si128(reinterpret_cast<const __m128i*>(src + i)));
+    }
+}
+
+void copy_nt_sse2(char* dst, const char* src, size_t bytes) {
+    for (size_t i = 0; i < bytes; i += 16) {
+        _mm_stream_si128(reinterpret_cast<__m128i*>(dst + i), _mm_load_si128(reinterpret_cast<const __m128i*>(src + i)));
+    }
+    _mm_sfence();
+}
+#endif
+
+#if REFERENCE_HAS_AVX2
+__attribute__((target("avx2"))) uint64_t read_avx2(const char* p, size_t bytes) {
+    __m256i a = _mm256_setzero_si256(), b = a;
+    for (size_t i = 0; i < bytes; i += kLine) {
+        a = _mm256_or_si256(a, _mm256_load_si256(reinterpret_cast<const __m256i*>(p + i)));
+        b = _mm256_or_si256(b, _mm256_load_si256(reinterpret_cast<const __m256i*>(p + i + 32)));
+    }
+    const __m256i all = _mm256_or_si256(a, b);
+    return static_cast<uint64_t>(_mm256_extract_epi64(all, 0) | _mm256_extract_epi64(all, 3));
+}
+
+__attribute__((target("avx2"))) void write_avx2(char* p, size_t bytes) {
+    const __m256i v = _mm256_set1_epi32(0x5a5a5a5a);
+    for (size_t i = 0; i < bytes; i += 32) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(p + i), v);
+    }
+}
+
+__attribute__((target("avx2"))) void write_nt_avx2(char* p, size_t bytes) {
+    const __m256i v = _mm256_set1_epi32(0x5a5a5a5a);
+    for (size_t i = 0; i < bytes; i += 32) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(p + i), v);
+    }
+    _mm_sfence();
+}
+
+__attribute__((target("avx2"))) void copy_avx2(char* dst, const char* src, size_t bytes) {
+    for (size_t i = 0; i < bytes; i += 32) {
+        _mm256_store_si256(reinterpret_cast<__m256i*>(dst + i),
+                           _mm256_load_si256(reinterpret_cast<const __m256i*>(src + i)));
+    }
+}
+
+__attribute__((target("avx2"))) void copy_nt_avx2(char* dst, const char* src, size_t bytes) {
+    for (size_t i = 0; i < bytes; i += 32) {
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(dst + i),
+                            _mm256_load_si256(reinterpret_cast<const __m256i*>(src + i)));
+    }
+    _mm_sfence();
+}
+#endif
+
+// Widest kernels the CPU supports. Without SSE2 the "nt" kernels fall back
+// to ordinary stores.
+struct Kernels {
+    const char* isa;
+    ReadKernel read;
+    WriteKernel write;
+    WriteKernel write_nt;
+    CopyKernel copy;
+    CopyKernel copy_nt;
+};
+
+Kernels select_kernels() {
+#if REFERENCE_HAS_AVX2
+    if (__builtin_cpu_supports("avx2")) {
+        return Kernels{"avx2", read_avx2, write_avx2, write_nt_avx2, copy_avx2, copy_nt_avx2};
+    }
+#endif
+#if REFERENCE_HAS_SSE2
+    return Kernels{"sse2", read_sse2, write_sse2, write_nt_sse2, copy_sse2, copy_nt_sse2};
+#else
+    return Kernels{"scalar", read_scalar, write_scalar, write_scalar, copy_scalar, copy_scalar};
+#endif
+}
+
+std::string size_label(size_t bytes) {
+    if (bytes >= 1024 * 1024) {
+        return std::to_string(bytes / (1024 * 1024)) + "MB";
+    }
+    return std::to_string(bytes / 1024) + "KB";
+}
+
+PerfLite::Benchmark reference_config(const std::string& name) {
+    return PerfLite::Benchmark().name(name).warmup(100).target_duration(std::chrono::milliseconds(50));
+}
+
+struct alignas(kLine) Node {
+    Node* next;
+    char pad[kLine - sizeof(Node*)];
+};
+
+// Average latency of one dependent load over a working set of `bytes`.
+PerfLite::BenchmarkResult measure_latency(const std::string& name, size_t bytes) {
+    AlignedBuffer buffer(bytes);
+    Node* nodes = reinterpret_cast<Node*>(buffer.data());
+    const size_t count = bytes / sizeof(Node);
+    std::vector<size_t> order(count);
+    std::iota(order.begin(), order.end(), size_t{0});
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(42));
+    for (size_t i = 0; i < count; ++i) {
+        nodes[order[i]].next = &nodes[order[(i + 1) % count]];
+    }
+
+    Node* cursor = &nodes[order[0]];
+    return reference_config(name).items_per_iteration(kChaseLoads).run([&cursor] {
+        Node* p = cursor;
+        for (size_t i = 0; i < kChaseLoads; ++i) {
+            p = p->next;
+        }
+        cursor = p;
+        PerfLite::DoNotOptimize(cursor);
+    });
+}
+
+// Streams `chunk` bytes per call through a buffer of `bytes`.
+template<typename Kernel>
+PerfLite::BenchmarkResult measure_stream(const std::string& name, size_t bytes, double traffic_per_byte,
+                                         Kernel&& kernel) {
+    const size_t chunk = std::min(bytes, kChunk);
+    size_t offset = 0;
+    return reference_config(name).bytes_per_iteration(traffic_per_byte * chunk).run([&] {
+        kernel(offset, chunk);
+        offset += chunk;
+        if (offset >= bytes) {
+            offset = 0;
+        }
+    });
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    PerfLite::RunnerOptions options;
+    if (!PerfLite::parse_runner_options(argc, argv, options)) {
+        return 1;
+    }
+    if (options.help) {
+        std::cout << "Usage: " << argv[0] << " [--filter=<regex>] [--format=console|json|csv] [--output=<file>]\n"
+                  << "Kernels: latency, read, write, write_nt, copy, copy_nt; working sets "
+                  << size_label(kMinWorkingSet) << " .. " << size_label(kMaxWorkingSet) << "\n";
+        return 0;
+    }
+    std::regex filter;
+    try {
+        filter = std::regex(options.filter);
+    } catch (const std::regex_error& e) {
+        std::cerr << "Error: invalid --filter pattern '" << options.filter << "': " << e.what() << "\n";
+        return 1;
+    }
+
+    const Kernels kernels = select_kernels();
+    std::vector<std::string> names;
+    for (const char* kernel : {"latency", "read", "write", "write_nt", "copy", "copy_nt"}) {
+        for (size_t bytes = kMinWorkingSet; bytes <= kMaxWorkingSet; bytes *= 4) {
+            names.push_back(std::string(kernel) + "/" + size_label(bytes));
+        }
+    }
+    if (options.list) {
+        for (const auto& name : names) {
+            std::cout << name << "\n";
+        }
+        return 0;
+    }
+
+    const bool console = options.format == "console";
+    if (console) {
+        std::cout << "Reference suite (" << kernels.isa << " kernels)\n";
+    }
+    std::vector<PerfLite::BenchmarkResult> results;
+    for (const auto& name : names) {
+        if (!std::regex_search(name, filter)) {
+            continue;
+        }
+        const std::string kernel = name.substr(0, name.find('/'));
+        size_t bytes = kMinWorkingSet;
+        while (size_label(bytes) != name.substr(name.find('/') + 1)) {
+            bytes *= 4;
+        }
+
+        PerfLite::BenchmarkResult result;
+        if (kernel == "latency") {
+            result = measure_latency(name, bytes);
+        } else if (kernel == "read") {
+            AlignedBuffer src(bytes);
+            result = measure_stream(name, bytes, 1.0, [&](size_t offset, size_t chunk) {
+                uint64_t sink = kernels.read(src.data() + offset, chunk);
+                PerfLite::DoNotOptimize(sink);
+            });
+        } else if (kernel == "write" || kernel == "write_nt") {
+            AlignedBuffer dst(bytes);
+            const WriteKernel write = (kernel == "write") ? kernels.write : kernels.write_nt;
+            result = measure_stream(name, bytes, 1.0, [&](size_t offset, size_t chunk) {
+                write(dst.data() + offset, chunk);
+            });
+        } else {
+            // Copy traffic counts the bytes read plus the bytes written
+            AlignedBuffer src(bytes);
+            AlignedBuffer dst(bytes);
+            const CopyKernel copy = (kernel == "copy") ? kernels.copy : kernels.copy_nt;
+            result = measure_stream(name, bytes, 2.0, [&](size_t offset, size_t chunk) {
+                copy(dst.data() + offset, src.data() + offset, chunk);
+            });
+        }
+        result.complexity_n = bytes;
+
+        if (console) {
+            std::cout << "  " << std::left << std::setw(18) << name << std::right << std::fixed << std::setprecision(2);
+            if (kernel == "latency") {
+                std::cout << std::setw(10) << result.median_time / kChaseLoads << " ns/load\n";
+            } else {
+                std::cout << std::setw(10) << result.bytes_per_sec / 1e9 << " GB/s\n";
+            }
+        }
+        results.push_back(std::move(result));
+    }
+    return PerfLite::write_report(options, results) ? 0 : 1;
+}
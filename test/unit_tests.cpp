@@ -1,4 +1,6 @@
 #include <gtest/gtest.h>
+// Installs the allocation-counting operator new/delete for this binary
+#define PERFLITE_TRACK_ALLOCATIONS
 #include "../perf_lite.h"
 
 using namespace PerfLite;
@@ -34,3 +36,1257 @@ TEST(UnitTests, CalculateStatisticsDeterministic) {
     // Ops/sec = 1e9 / 2000 ns = 500000
     EXPECT_NEAR(r.ops_per_sec, 500000.0, 1e-6);
 }
+
+// Overhead subtraction shifts min/mean but leaves the spread untouched
+TEST(UnitTests, CalculateStatisticsSubtractsOverhead) {
+    BenchmarkResult r(TimeUnit::Microseconds);
+    r.durations.push_back(std::chrono::duration<double, std::nano>(1000.0));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(2000.0));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(3000.0));
+    r.overhead_ns = 500.0;
+    r.subtract_overhead = true;
+
+    r.calculate_statistics();
+
+    EXPECT_NEAR(r.overhead_time, 0.5, 1e-12);
+    EXPECT_NEAR(r.mean_time, 1.5, 1e-12);
+    EXPECT_NEAR(r.min_time, 0.5, 1e-12);
+    EXPECT_NEAR(r.stddev_time, 1.0, 1e-12);
+    // Ops/sec follows the corrected mean: 1e9 / 1500 ns
+    EXPECT_NEAR(r.ops_per_sec, 1e9 / 1500.0, 1e-6);
+}
+
+// Cycle counts follow the reported times through the tick ratio
+TEST(UnitTests, CalculateStatisticsReportsCycles) {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.durations.push_back(std::chrono::duration<double, std::nano>(10.0));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(30.0));
+    r.cycles_per_ns = 3.0;
+
+    r.calculate_statistics();
+
+    EXPECT_NEAR(r.min_cycles, 30.0, 1e-9);
+    EXPECT_NEAR(r.mean_cycles, 60.0, 1e-9);
+}
+
+// Without a cycle counter no cycle figures are reported
+TEST(UnitTests, ChronoClockReportsNoCycles) {
+    BenchmarkResult r;
+    r.durations.push_back(std::chrono::duration<double, std::nano>(10.0));
+    r.calculate_statistics();
+    EXPECT_EQ(r.mean_cycles, 0.0);
+    EXPECT_EQ(r.clock, ClockSource::Chrono);
+}
+
+// Welford accumulator matches the two-pass statistics
+TEST(UnitTests, OnlineStatisticsMatchesBatchStatistics) {
+    BenchmarkResult r(TimeUnit::Microseconds);
+    r.online.prepare();
+    r.online.add(1000.0);
+    r.online.add(2000.0);
+    r.online.add(3000.0);
+
+    r.calculate_statistics();
+
+    EXPECT_TRUE(r.durations.empty());
+    EXPECT_EQ(r.sample_count, 3u);
+    EXPECT_NEAR(r.mean_time, 2.0, 1e-12);
+    EXPECT_NEAR(r.min_time, 1.0, 1e-12);
+    EXPECT_NEAR(r.stddev_time, 1.0, 1e-12);
+    EXPECT_DOUBLE_EQ(r.online.max, 3000.0);
+}
+
+// Histogram buckets are contiguous and quantiles stay within the bucket precision
+TEST(UnitTests, LatencyHistogramQuantiles) {
+    LatencyHistogram h;
+    h.prepare();
+    for (int i = 1; i <= 10000; ++i) {
+        h.record(static_cast<double>(i));
+    }
+
+    EXPECT_EQ(h.total(), 10000u);
+    EXPECT_NEAR(h.quantile(0.5), 5000.0, 5000.0 * 0.02);
+    EXPECT_NEAR(h.quantile(0.99), 9900.0, 9900.0 * 0.02);
+    for (size_t i = 1; i < LatencyHistogram::kBucketCount; ++i) {
+        ASSERT_DOUBLE_EQ(LatencyHistogram::bucket_upper(i - 1), LatencyHistogram::bucket_lower(i));
+    }
+    EXPECT_EQ(LatencyHistogram::index_of(1e30), LatencyHistogram::kBucketCount - 1);
+}
+
+// Median, MAD, percentiles and max from raw samples
+TEST(UnitTests, CalculateStatisticsPercentiles) {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.percentile_levels = {50.0, 90.0, 100.0};
+    for (int i = 1; i <= 11; ++i) {
+        r.durations.push_back(std::chrono::duration<double, std::nano>(i * 10.0));
+    }
+
+    r.calculate_statistics();
+
+    EXPECT_NEAR(r.median_time, 60.0, 1e-9);
+    EXPECT_NEAR(r.max_time, 110.0, 1e-9);
+    // |x - 60| = 50,40,...,0,...,50 -> median 30
+    EXPECT_NEAR(r.mad_time, 30.0, 1e-9);
+    ASSERT_EQ(r.percentiles.size(), 3u);
+    EXPECT_NEAR(r.percentile(50.0), 60.0, 1e-9);
+    EXPECT_NEAR(r.percentile(90.0), 100.0, 1e-9);
+    EXPECT_NEAR(r.percentile(100.0), 110.0, 1e-9);
+    EXPECT_EQ(r.percentile(99.0), 0.0);
+}
+
+// Log2 histogram covers every sample exactly once
+TEST(UnitTests, CalculateStatisticsHistogram) {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.durations.push_back(std::chrono::duration<double, std::nano>(0.5));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(3.0));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(3.5));
+    r.durations.push_back(std::chrono::duration<double, std::nano>(100.0));
+
+    r.calculate_statistics();
+
+    uint64_t total = 0;
+    for (const auto& bin : r.histogram) {
+        total += bin.count;
+        EXPECT_LT(bin.lower, bin.upper);
+    }
+    EXPECT_EQ(total, 4u);
+    EXPECT_EQ(r.histogram.front().lower, 0.0);
+    EXPECT_EQ(r.histogram.front().count, 1u);
+    EXPECT_EQ(r.histogram.back().lower, 64.0);
+}
+
+// Merging streaming accumulators matches accumulating all samples in one
+TEST(UnitTests, OnlineStatisticsMerge) {
+    OnlineStatistics all, left, right;
+    all.prepare();
+    left.prepare();
+    right.prepare();
+    for (int i = 1; i <= 10; ++i) {
+        all.add(i * 1.5);
+        (i <= 4 ? left : right).add(i * 1.5);
+    }
+    left.merge(right);
+
+    EXPECT_EQ(left.count, all.count);
+    EXPECT_NEAR(left.mean, all.mean, 1e-12);
+    EXPECT_NEAR(left.variance(), all.variance(), 1e-9);
+    EXPECT_DOUBLE_EQ(left.min, all.min);
+    EXPECT_DOUBLE_EQ(left.max, all.max);
+    EXPECT_EQ(left.histogram.total(), 10u);
+}
+
+// Spin barrier releases every participant on each round
+TEST(UnitTests, SpinBarrierReleasesAllThreads) {
+    constexpr size_t kThreads = 3;
+    SpinBarrier barrier(kThreads);
+    std::atomic<int> passed{0};
+    std::vector<std::thread> pool;
+    for (size_t t = 0; t < kThreads; ++t) {
+        pool.emplace_back([&] {
+            for (int round = 0; round < 5; ++round) {
+                barrier.arrive_and_wait();
+                passed.fetch_add(1);
+            }
+        });
+    }
+    for (auto& thread : pool) {
+        thread.join();
+    }
+    EXPECT_EQ(passed.load(), 15);
+}
+
+// Environment warnings fire only for the unstable conditions
+TEST(UnitTests, EnvironmentWarnings) {
+    EnvironmentInfo env;
+    env.logical_cpus = 8;
+    env.governor = "performance";
+    env.turbo = 0;
+    env.load_average = 0.5;
+    std::ostringstream quiet;
+    EXPECT_EQ(env.warn(quiet), 0);
+    EXPECT_TRUE(quiet.str().empty());
+
+    env.governor = "powersave";
+    env.turbo = 1;
+    env.load_average = 6.0;
+    std::ostringstream noisy;
+    EXPECT_EQ(env.warn(noisy), 3);
+    EXPECT_NE(noisy.str().find("powersave"), std::string::npos);
+}
+
+// Registry: macros add benchmarks in registration order and the filter selects by regex
+PERFLITE_BENCHMARK(registry_probe_alpha) {
+    volatile int x = 0;
+    x += 1;
+}
+
+static int registry_probe_beta() { return 7; }
+PERFLITE_REGISTER(registry_probe_beta).target_duration(std::chrono::milliseconds(1)).iterations(10);
+
+// Typed registration: one benchmark per type, each with its own name
+template<typename T>
+static T typed_probe_sum() {
+    T total = T();
+    for (int i = 0; i < 16; ++i) {
+        total += static_cast<T>(i);
+    }
+    return total;
+}
+PERFLITE_REGISTER_TEMPLATE(typed_probe_sum, int, double);
+
+static int fixture_probe_constructions = 0;
+struct FixtureProbe {
+    std::vector<int> data;
+    FixtureProbe() : data(256, 1) { ++fixture_probe_constructions; }
+};
+PERFLITE_FIXTURE(FixtureProbe, sum) {
+    int total = std::accumulate(data.begin(), data.end(), 0);
+    DoNotOptimize(total);
+}
+
+template<typename T>
+struct TypedFixtureProbe {
+    std::vector<T> values = std::vector<T>(64, T(2));
+};
+PERFLITE_TYPED_FIXTURE(TypedFixtureProbe, product, int, float) {
+    T product = T(1);
+    for (const T v : this->values) {
+        product *= v;
+    }
+    DoNotOptimize(product);
+}
+
+static void allocation_check_probe() {
+    std::vector<int> v(16, 1);
+    DoNotOptimize(v);
+}
+PERFLITE_REGISTER(allocation_check_probe).expect_no_allocations().target_duration(std::chrono::milliseconds(1));
+
+TEST(UnitTests, RegistryMacrosAndFilter) {
+    auto all = Registry::instance().matching("registry_probe_");
+    ASSERT_EQ(all.size(), 2u);
+    EXPECT_EQ(all[0]->name, "registry_probe_alpha");
+    EXPECT_EQ(all[1]->name, "registry_probe_beta");
+
+    auto beta = Registry::instance().matching("beta$");
+    ASSERT_EQ(beta.size(), 1u);
+    EXPECT_EQ(beta[0]->name, "registry_probe_beta");
+
+    RunnerOptions options;
+    options.filter = "registry_probe_beta";
+    options.repetitions = 2;
+    std::ostringstream out;
+    auto results = run_registered(options, out);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].name, "registry_probe_beta");
+    EXPECT_EQ(results[1].repetition, 1u);
+    EXPECT_NE(out.str().find("registry_probe_beta"), std::string::npos);
+    EXPECT_NE(out.str().find("Repetitions: registry_probe_beta (2 runs)"), std::string::npos);
+
+    // Interleaved runs still come back grouped in registration order
+    options.filter = "registry_probe_";
+    options.interleave = true;
+    std::ostringstream interleaved;
+    results = run_registered(options, interleaved);
+    ASSERT_EQ(results.size(), 4u);
+    EXPECT_EQ(results[0].name, "registry_probe_alpha");
+    EXPECT_EQ(results[1].name, "registry_probe_alpha");
+    EXPECT_EQ(results[2].name, "registry_probe_beta");
+    const std::string text = interleaved.str();
+    EXPECT_LT(text.find("Benchmark: registry_probe_beta"), text.rfind("Benchmark: registry_probe_alpha"));
+}
+
+TEST(UnitTests, AggregateRepetitions) {
+    std::vector<BenchmarkResult> runs;
+    for (double mean : {10.0, 12.0, 11.0, 30.0}) {
+        BenchmarkResult r;
+        r.name = "repeated";
+        r.mean_time = mean;
+        runs.push_back(r);
+    }
+    const RepetitionResult agg = aggregate_repetitions(runs);
+    EXPECT_EQ(agg.name, "repeated");
+    ASSERT_EQ(agg.runs.size(), 4u);
+    EXPECT_DOUBLE_EQ(agg.mean, 15.75);
+    EXPECT_DOUBLE_EQ(agg.median, 11.5);
+    EXPECT_NEAR(agg.stddev, 9.5350, 1e-4);
+    EXPECT_NEAR(agg.cv, 9.5350 / 15.75, 1e-5);
+    EXPECT_FALSE(agg.reproducible());
+}
+
+// Runner flags are parsed and invalid input is rejected
+TEST(UnitTests, ParseRunnerOptions) {
+    const char* good[] = {"bench", "--filter=hash.*", "--list", "--repetitions=3", "--interleave"};
+    RunnerOptions options;
+    std::ostringstream err;
+    ASSERT_TRUE(parse_runner_options(5, const_cast<char**>(good), options, err));
+    EXPECT_TRUE(options.interleave);
+    EXPECT_EQ(options.filter, "hash.*");
+    EXPECT_TRUE(options.list);
+    EXPECT_EQ(options.repetitions, 3u);
+
+    const char* bad_count[] = {"bench", "--repetitions=0"};
+    RunnerOptions rejected;
+    EXPECT_FALSE(parse_runner_options(2, const_cast<char**>(bad_count), rejected, err));
+    const char* unknown[] = {"bench", "--frobnicate"};
+    EXPECT_FALSE(parse_runner_options(2, const_cast<char**>(unknown), rejected, err));
+
+    const char* outputs[] = {"bench", "--format=json", "--output=out.csv", "--output-format=csv",
+                             "--samples-output=out.bin", "--trace=trace.json"};
+    RunnerOptions reports;
+    ASSERT_TRUE(parse_runner_options(6, const_cast<char**>(outputs), reports, err));
+    EXPECT_EQ(reports.format, "json");
+    EXPECT_EQ(reports.output, "out.csv");
+    EXPECT_EQ(reports.output_format, "csv");
+    EXPECT_EQ(reports.samples_output, "out.bin");
+    EXPECT_EQ(reports.trace, "trace.json");
+    const char* bad_format[] = {"bench", "--format=xml"};
+    EXPECT_FALSE(parse_runner_options(2, const_cast<char**>(bad_format), rejected, err));
+
+    const char* compare_flags[] = {"bench", "--baseline=base.json", "--threshold=0.1", "--alpha=0.01"};
+    RunnerOptions comparing;
+    ASSERT_TRUE(parse_runner_options(4, const_cast<char**>(compare_flags), comparing, err));
+    EXPECT_EQ(comparing.baseline, "base.json");
+    EXPECT_DOUBLE_EQ(comparing.compare.threshold, 0.1);
+    EXPECT_DOUBLE_EQ(comparing.compare.alpha, 0.01);
+    const char* bad_alpha[] = {"bench", "--alpha=1.5"};
+    EXPECT_FALSE(parse_runner_options(2, const_cast<char**>(bad_alpha), rejected, err));
+}
+
+// Complexity fitting picks the generating curve for synthetic series
+TEST(UnitTests, FitComplexitySelectsGeneratingCurve) {
+    auto series = [](auto f) {
+        std::vector<BenchmarkResult> results;
+        for (size_t n = 8; n <= (1u << 16); n *= 4) {
+            BenchmarkResult r;
+            r.complexity_n = n;
+            r.mean_time = f(static_cast<double>(n));
+            results.push_back(r);
+        }
+        return results;
+    };
+
+    auto constant = fit_complexity(series([](double) { return 5.0; }));
+    EXPECT_EQ(constant.complexity, Complexity::O1);
+    EXPECT_NEAR(constant.coefficient, 5.0, 1e-9);
+
+    auto linear = fit_complexity(series([](double n) { return 3.0 * n; }));
+    EXPECT_EQ(linear.complexity, Complexity::ON);
+    EXPECT_NEAR(linear.coefficient, 3.0, 1e-9);
+    EXPECT_NEAR(linear.rms, 0.0, 1e-9);
+
+    auto nlogn = fit_complexity(series([](double n) { return 2.0 * n * std::log2(n); }));
+    EXPECT_EQ(nlogn.complexity, Complexity::ONLogN);
+    EXPECT_EQ(nlogn.label(), "O(n log n)");
+
+    auto quadratic = fit_complexity(series([](double n) { return 0.5 * n * n + 10.0; }));
+    EXPECT_EQ(quadratic.complexity, Complexity::ON2);
+}
+
+// Range points grow geometrically and always include the end
+TEST(UnitTests, RangePoints) {
+    auto points = Benchmark().range(8, 1000).multiplier(4).range_points();
+    std::vector<size_t> expected = {8, 32, 128, 512, 1000};
+    EXPECT_EQ(points, expected);
+    EXPECT_EQ(Benchmark().range(16, 16).range_points(), std::vector<size_t>{16});
+}
+
+// State loop runs the requested iterations and excludes paused sections
+TEST(UnitTests, StateExcludesPausedWork) {
+    State state(3, ClockSource::Chrono);
+    int iterations = 0;
+    for (auto _ : state) {
+        state.pause_timing();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        state.resume_timing();
+        ++iterations;
+    }
+    EXPECT_EQ(iterations, 3);
+    EXPECT_EQ(state.iterations(), 3u);
+    // Three 5ms sleeps were paused; the timed part is far below that
+    EXPECT_LT(state.elapsed_ns(), 5e6);
+}
+
+TEST(UnitTests, TrackAllocationsCountsPerIteration) {
+    auto r = Benchmark()
+                 .warmup(10)
+                 .target_duration(std::chrono::milliseconds(5))
+                 .track_allocations()
+                 .run([] {
+                     int* p = new int(42);
+                     DoNotOptimize(p);
+                     delete p;
+                 });
+    ASSERT_TRUE(r.allocations_tracked);
+    EXPECT_DOUBLE_EQ(r.allocations_per_iteration, 1.0);
+    EXPECT_DOUBLE_EQ(r.allocated_bytes_per_iteration, static_cast<double>(sizeof(int)));
+    EXPECT_GE(r.peak_live_bytes, sizeof(int));
+}
+
+TEST(UnitTests, ExpectNoAllocations) {
+    Benchmark quiet;
+    quiet.warmup(10).target_duration(std::chrono::milliseconds(5)).expect_no_allocations();
+    EXPECT_NO_THROW(quiet.run([] { volatile int x = 1; (void)x; }));
+
+    Benchmark allocating;
+    allocating.warmup(10).target_duration(std::chrono::milliseconds(5)).expect_no_allocations();
+    EXPECT_THROW(allocating.run([] {
+        std::vector<int> v(4);
+        DoNotOptimize(v);
+    }), std::runtime_error);
+}
+
+// A request too large to pad with the block header fails instead of wrapping
+TEST(UnitTests, TrackedAllocationRejectsHugeRequests) {
+    volatile size_t huge = SIZE_MAX - 8;
+    EXPECT_THROW(::operator delete(::operator new(huge)), std::bad_alloc);
+    EXPECT_EQ(::operator new(huge, std::nothrow), nullptr);
+    EXPECT_EQ(::operator new[](huge, std::align_val_t{64}, std::nothrow), nullptr);
+}
+
+// Builds a small deterministic result for the reporter tests
+static BenchmarkResult reporter_sample() {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.name = "parse \"quoted\", header";
+    r.warmup_iterations = 10;
+    r.target_duration_ns = 1e8;
+    for (double v : {10.0, 20.0, 30.0, 40.0}) {
+        r.durations.emplace_back(v);
+    }
+    r.iterations = r.durations.size();
+    r.calculate_statistics();
+    return r;
+}
+
+TEST(UnitTests, WriteJsonAndCsv) {
+    const std::vector<BenchmarkResult> results{reporter_sample()};
+
+    std::ostringstream json;
+    write_json(json, results);
+    const std::string text = json.str();
+    EXPECT_NE(text.find("\"name\": \"parse \\\"quoted\\\", header\""), std::string::npos);
+    EXPECT_NE(text.find("\"warmup_iterations\": 10"), std::string::npos);
+    EXPECT_NE(text.find("\"target_duration_ns\": 100000000"), std::string::npos);
+    EXPECT_NE(text.find("\"mean\": 25,"), std::string::npos);
+    EXPECT_NE(text.find("\"p50\": "), std::string::npos);
+    EXPECT_NE(text.find("\"environment\": {"), std::string::npos);
+
+    std::ostringstream csv;
+    write_csv(csv, results);
+    std::istringstream lines(csv.str());
+    std::string header;
+    std::string row;
+    std::getline(lines, header);
+    std::getline(lines, row);
+    EXPECT_EQ(header.compare(0, 15, "name,time_unit,"), 0);
+    EXPECT_NE(header.find(",p99.9,"), std::string::npos);
+    const std::string quoted_name = "\"parse \"\"quoted\"\", header\",ns,";
+    EXPECT_EQ(row.compare(0, quoted_name.size(), quoted_name), 0);
+    EXPECT_NE(row.find(",25,"), std::string::npos);
+}
+
+TEST(UnitTests, SampleFileRoundTrip) {
+    BenchmarkResult streamed(TimeUnit::Nanoseconds);
+    streamed.name = "streamed";
+    const std::vector<BenchmarkResult> results{reporter_sample(), streamed};
+
+    std::stringstream file;
+    ASSERT_TRUE(write_samples(file, results));
+    std::vector<SampleSet> sets;
+    ASSERT_TRUE(read_samples(file, sets));
+    ASSERT_EQ(sets.size(), 2u);
+    EXPECT_EQ(sets[0].name, results[0].name);
+    ASSERT_EQ(sets[0].durations.size(), 4u);
+    EXPECT_EQ(sets[0].durations[3].count(), 40.0);
+    EXPECT_EQ(sets[1].name, "streamed");
+    EXPECT_TRUE(sets[1].durations.empty());
+
+    std::istringstream garbage("not a sample file at all");
+    std::ostringstream err;
+    std::vector<SampleSet> none;
+    EXPECT_FALSE(read_samples(garbage, none, err));
+
+    // Cutting the file short inside the first sample block must fail cleanly
+    const std::string bytes = file.str();
+    std::istringstream truncated(bytes.substr(0, bytes.size() - sizeof(double) * 3));
+    err.str("");
+    EXPECT_FALSE(read_samples(truncated, none, err));
+    EXPECT_NE(err.str().find("truncated"), std::string::npos);
+
+    // A corrupt sample count is rejected before it reaches resize()
+    std::string corrupt = bytes;
+    const size_t count_offset = sizeof(detail::kSampleMagic) + 2 * sizeof(uint32_t) + sizeof(uint32_t) +
+                                results[0].name.size() + sizeof(uint64_t);
+    const uint64_t huge = ~uint64_t{0} / sizeof(double);
+    corrupt.replace(count_offset, sizeof(huge), reinterpret_cast<const char*>(&huge), sizeof(huge));
+    std::istringstream oversized(corrupt);
+    err.str("");
+    none.clear();
+    EXPECT_FALSE(read_samples(oversized, none, err));
+    EXPECT_NE(err.str().find("corrupt"), std::string::npos);
+    EXPECT_TRUE(none.empty());
+}
+
+// Reference values: two-sided Student t p-values from standard tables
+TEST(UnitTests, StudentTPValues) {
+    EXPECT_NEAR(detail::student_t_two_sided_p(2.0, 10.0), 0.07339, 1e-4);
+    EXPECT_NEAR(detail::student_t_two_sided_p(2.228, 10.0), 0.05, 1e-4);
+    EXPECT_NEAR(detail::student_t_two_sided_p(1.96, 1e6), 0.05, 1e-4);
+    EXPECT_NEAR(detail::student_t_critical(0.05, 10.0), 2.228, 1e-3);
+}
+
+TEST(UnitTests, MannWhitneyDetectsShift) {
+    std::vector<double> base;
+    std::vector<double> same;
+    std::vector<double> shifted;
+    for (int i = 0; i < 200; ++i) {
+        const double v = 100.0 + (i * 37 % 50);
+        base.push_back(v);
+        same.push_back(100.0 + ((i * 37 + 11) % 50));
+        shifted.push_back(v + 10.0);
+    }
+    EXPECT_GT(detail::mann_whitney_p(base, same), 0.05);
+    EXPECT_LT(detail::mann_whitney_p(base, shifted), 1e-6);
+}
+
+// A JSON report read back as a baseline flags a significant slowdown only
+TEST(UnitTests, CompareAgainstJsonBaseline) {
+    auto make = [](const std::string& name, double offset) {
+        BenchmarkResult r(TimeUnit::Microseconds);
+        r.name = name;
+        for (int i = 0; i < 500; ++i) {
+            r.durations.emplace_back(1000.0 + offset + (i % 20));
+        }
+        r.calculate_statistics();
+        return r;
+    };
+    std::stringstream json;
+    write_json(json, {make("steady", 0.0), make("slower", 0.0)});
+    std::vector<BaselineEntry> baseline;
+    ASSERT_TRUE(read_baseline_json(json, baseline));
+    ASSERT_EQ(baseline.size(), 2u);
+    EXPECT_NEAR(baseline[0].mean_ns, 1009.5, 1e-6);
+
+    CompareOptions options;
+    options.threshold = 0.05;
+    const std::vector<Comparison> results = compare(baseline, {make("steady", 1.0), make("slower", 200.0)}, options);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].test, "welch");
+    EXPECT_FALSE(results[0].regression);  // 0.1% slower: below the threshold
+    EXPECT_TRUE(results[1].regression);
+    EXPECT_NEAR(results[1].delta, 200.0 / 1009.5, 1e-9);
+    EXPECT_LT(results[1].ci_low, results[1].delta);
+    EXPECT_GT(results[1].ci_high, results[1].delta);
+
+    std::stringstream samples;
+    write_samples(samples, {make("slower", 0.0)});
+    std::vector<SampleSet> sets;
+    ASSERT_TRUE(read_samples(samples, sets));
+    attach_baseline_samples(baseline, sets);
+    EXPECT_EQ(compare(baseline[1], make("slower", 200.0), options).test, "mann-whitney");
+
+    std::istringstream broken("{\"benchmarks\": [");
+    std::ostringstream err;
+    std::vector<BaselineEntry> none;
+    EXPECT_FALSE(read_baseline_json(broken, none, err));
+}
+
+// Tukey fences: quartiles 100.75 and 103 give mild fences at [97.375, 106.375]
+// and severe fences at [94, 109.75]
+TEST(UnitTests, OutlierClassification) {
+    std::vector<double> values;
+    for (int i = 0; i < 96; ++i) {
+        values.push_back(100.0 + (i % 4));
+    }
+    for (double v : {108.0, 1000.0, 1000.0, 50.0}) {
+        values.push_back(v);
+    }
+
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.name = "outliers";
+    r.trim_fraction = 0.05;
+    for (double v : values) {
+        r.durations.emplace_back(v);
+    }
+    r.calculate_statistics();
+    EXPECT_EQ(r.outliers.low_severe, 1u);
+    EXPECT_EQ(r.outliers.low_mild, 0u);
+    EXPECT_EQ(r.outliers.high_mild, 1u);
+    EXPECT_EQ(r.outliers.high_severe, 2u);
+    EXPECT_DOUBLE_EQ(r.outlier_fraction, 0.04);
+    EXPECT_NEAR(r.inlier_mean_time, 101.5, 1e-9);
+    EXPECT_LT(r.inlier_stddev_time, r.stddev_time);
+    EXPECT_NEAR(r.trimmed_mean_time, 9138.0 / 90.0, 1e-9);
+
+    // Streaming mode classifies from the histogram buckets
+    BenchmarkResult streamed(TimeUnit::Nanoseconds);
+    streamed.name = "outliers_streamed";
+    streamed.online.prepare();
+    for (double v : values) {
+        streamed.online.add(v);
+    }
+    streamed.calculate_statistics();
+    EXPECT_EQ(streamed.outliers.total(), 4u);
+    EXPECT_NEAR(streamed.inlier_mean_time, 101.5, 1.0);
+}
+
+TEST(UnitTests, ThroughputFromBytesAndItems) {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.name = "throughput";
+    r.bytes_per_iteration = 4096.0;
+    r.items_per_iteration = 64.0;
+    for (int i = 0; i < 10; ++i) {
+        r.durations.emplace_back(100.0);
+    }
+    r.calculate_statistics();
+    EXPECT_DOUBLE_EQ(r.ops_per_sec, 1e7);
+    EXPECT_DOUBLE_EQ(r.bytes_per_sec, 4096.0 * 1e7);
+    EXPECT_DOUBLE_EQ(r.items_per_sec, 64.0 * 1e7);
+
+    std::ostringstream out;
+    r.print(out);
+    EXPECT_NE(out.str().find("40.96 GB/s"), std::string::npos);
+}
+
+namespace {
+
+struct CopyCounter {
+    static inline int copies = 0;
+    int value = 7;
+    CopyCounter() = default;
+    CopyCounter(const CopyCounter& other) : value(other.value) { ++copies; }
+    CopyCounter& operator=(const CopyCounter& other) { value = other.value; ++copies; return *this; }
+};
+
+struct Accumulator {
+    long total = 0;
+    long add(int x) { return total += x; }
+};
+
+int twice(int x) { return 2 * x; }
+
+} // namespace
+
+// The timed call is direct: bound arguments are references, fn<> is empty,
+// and nothing is type-erased
+TEST(UnitTests, BoundCallHasNoIndirection) {
+    auto lambda = [](const CopyCounter&) {};
+    using Bound = detail::BoundCall<decltype(lambda), CopyCounter>;
+    static_assert(std::is_empty_v<FunctionConstant<&twice>>);
+    static_assert(sizeof(Bound) == 2 * sizeof(void*));
+    static_assert(std::is_trivially_destructible_v<Bound>);
+    // The callable and its arguments are held by reference, not boxed
+    static_assert(std::is_same_v<decltype(Bound::func), decltype(lambda)&>);
+    static_assert(std::is_same_v<decltype(Bound::args), std::tuple<CopyCounter&>>);
+    static_assert(std::is_same_v<decltype(fn<&twice>(1)), int>);
+    EXPECT_EQ(fn<&twice>(21), 42);
+}
+
+TEST(UnitTests, RunDoesNotCopyArguments) {
+    CopyCounter arg;
+    CopyCounter::copies = 0;
+    long sum = 0;
+    Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).run(
+        [&sum](const CopyCounter& c) { sum += c.value; }, arg);
+    EXPECT_EQ(CopyCounter::copies, 0);
+    EXPECT_GT(sum, 0);
+
+    // Reference returns are observed in place rather than copied out
+    Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).run(
+        [](CopyCounter& c) -> CopyCounter& { return c; }, arg);
+    EXPECT_EQ(CopyCounter::copies, 0);
+}
+
+TEST(UnitTests, RunInvokesMemberPointersAndConstants) {
+    Accumulator acc;
+    Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).run(&Accumulator::add, acc, 1);
+    EXPECT_GT(acc.total, 0);
+
+    auto r = benchmark(fn<&twice>, 3);
+    EXPECT_GT(r.durations.size(), 0u);
+}
+
+TEST(UnitTests, SampleArenaReserveKeepsSamples) {
+    detail::SampleArena arena;
+    arena.reserve(10);
+    EXPECT_GE(arena.capacity(), 10u);
+    EXPECT_EQ(arena.capacity() * sizeof(double) % detail::SampleArena::kPageBytes, 0u);
+    for (int i = 0; i < 10; ++i) {
+        arena.push(static_cast<double>(i));
+    }
+    const double* before = arena.begin();
+    arena.reserve(5);
+    EXPECT_EQ(arena.begin(), before);
+
+    arena.reserve(arena.capacity() + 1);
+    ASSERT_EQ(arena.size(), 10u);
+    EXPECT_DOUBLE_EQ(arena[9], 9.0);
+
+    std::vector<std::chrono::duration<double, std::nano>> out;
+    arena.append_to(out);
+    ASSERT_EQ(out.size(), 10u);
+    EXPECT_DOUBLE_EQ(out[3].count(), 3.0);
+}
+
+// Sample storage is reused between runs and its growth in the adaptive
+// loop is not counted as an allocation of the benchmarked code
+TEST(UnitTests, SampleArenaReusedAcrossRuns) {
+    auto r = Benchmark()
+                 .warmup(10)
+                 .confidence_target(0.5)
+                 .max_time(std::chrono::milliseconds(50))
+                 .track_allocations()
+                 .run([] { volatile int x = 1; (void)x; });
+    EXPECT_DOUBLE_EQ(r.allocations_per_iteration, 0.0);
+    EXPECT_EQ(r.durations.size(), r.iterations / r.batch_size);
+
+    detail::SampleArena::for_this_thread().reserve(size_t{1} << 22);
+    const double* arena = detail::SampleArena::for_this_thread().begin();
+    Benchmark().warmup(10).target_duration(std::chrono::milliseconds(1)).run([] { return 1; });
+    EXPECT_EQ(detail::SampleArena::for_this_thread().begin(), arena);
+}
+
+// Every kernel the CPU supports agrees with the scalar one, including the
+// tails that do not fill a vector
+TEST(UnitTests, StatisticsKernelsMatchScalar) {
+    std::vector<double> samples;
+    for (int i = 0; i < 1003; ++i) {
+        samples.push_back(1e9 + static_cast<double>((i * 7919) % 101) * 0.25);
+    }
+    samples.push_back(0.5);
+    samples.push_back(1e12);
+
+    const detail::SampleMoments scalar = detail::sample_moments_scalar(samples.data(), samples.size());
+    EXPECT_DOUBLE_EQ(scalar.min, 0.5);
+    EXPECT_DOUBLE_EQ(scalar.max, 1e12);
+
+    std::vector<uint64_t> expected_bins(detail::kLog2BinCount, 0);
+    for (const double v : samples) {
+        ++expected_bins[(v < 1.0) ? 0 : static_cast<size_t>(std::floor(std::log2(v))) + 1];
+    }
+
+    std::vector<detail::SimdLevel> levels{detail::SimdLevel::Scalar};
+    if (detail::simd_level() == detail::SimdLevel::Avx512) {
+        levels.push_back(detail::SimdLevel::Avx2);
+    }
+    levels.push_back(detail::simd_level());
+    for (const auto level : levels) {
+        for (const size_t n : {size_t{0}, size_t{1}, size_t{7}, samples.size()}) {
+            const auto m = detail::sample_moments(samples.data(), n, level);
+            const auto reference = detail::sample_moments_scalar(samples.data(), n);
+            EXPECT_EQ(m.count, n);
+            EXPECT_DOUBLE_EQ(m.mean(), reference.mean());
+            EXPECT_NEAR(m.variance(), reference.variance(), 1e-9 * reference.variance());
+            EXPECT_DOUBLE_EQ(m.min, reference.min);
+            EXPECT_DOUBLE_EQ(m.max, reference.max);
+        }
+        std::vector<uint64_t> bins(detail::kLog2BinCount, 0);
+        detail::log2_bin_counts(samples.data(), samples.size(), bins.data(), level);
+        EXPECT_EQ(bins, expected_bins);
+    }
+}
+
+// One-pass shifted moments keep the precision of the two-pass formula
+TEST(UnitTests, SampleMomentsLargeOffset) {
+    std::vector<double> samples;
+    for (int i = 0; i < 10000; ++i) {
+        samples.push_back(1e10 + ((i % 2) ? 1.0 : -1.0));
+    }
+    const auto m = detail::sample_moments(samples.data(), samples.size());
+    EXPECT_DOUBLE_EQ(m.mean(), 1e10);
+    EXPECT_NEAR(m.variance(), 10000.0 / 9999.0, 1e-9);
+}
+
+// Selecting the needed ranks gives the same estimates as a full sort
+TEST(UnitTests, SelectedQuantilesMatchSort) {
+    BenchmarkResult r(TimeUnit::Nanoseconds);
+    r.name = "selection";
+    r.trim_fraction = 0.05;
+    r.percentile_levels = {50.0, 90.0, 99.0};
+    std::vector<double> values;
+    for (int i = 0; i < 997; ++i) {
+        values.push_back(100.0 + static_cast<double>((i * 7919) % 997) + ((i % 50 == 0) ? 5000.0 : 0.0));
+    }
+    for (const double v : values) {
+        r.durations.emplace_back(v);
+    }
+    r.calculate_statistics();
+
+    std::sort(values.begin(), values.end());
+    auto quantile = [&values](double q) {
+        const double pos = q * static_cast<double>(values.size() - 1);
+        const size_t lo = static_cast<size_t>(pos);
+        return values[lo] + (values[lo + 1] - values[lo]) * (pos - static_cast<double>(lo));
+    };
+    EXPECT_DOUBLE_EQ(r.median_time, quantile(0.5));
+    EXPECT_DOUBLE_EQ(r.percentiles[1].time, quantile(0.9));
+    EXPECT_DOUBLE_EQ(r.percentiles[2].time, quantile(0.99));
+
+    const double cut = 0.05 * static_cast<double>(values.size());
+    double sum = 0.0;
+    double weight = 0.0;
+    for (size_t i = 0; i < values.size(); ++i) {
+        const double kept = std::max(0.0, std::min(i + 1.0, values.size() - cut) - std::max(static_cast<double>(i), cut));
+        sum += kept * values[i];
+        weight += kept;
+    }
+    EXPECT_NEAR(r.trimmed_mean_time, sum / weight, 1e-9);
+}
+
+TEST(UnitTests, CpuListsAndPhysicalCores) {
+    EXPECT_EQ(detail::parse_cpu_list("0-3,8,10-11"), (std::vector<int>{0, 1, 2, 3, 8, 10, 11}));
+    EXPECT_EQ(detail::parse_cpu_list("5"), std::vector<int>{5});
+    EXPECT_TRUE(detail::parse_cpu_list("").empty());
+
+    const std::vector<int> allowed = detail::allowed_cpus();
+    const std::vector<int> cores = detail::physical_core_cpus();
+    EXPECT_LE(cores.size(), allowed.size());
+    for (const int cpu : cores) {
+        EXPECT_NE(std::find(allowed.begin(), allowed.end(), cpu), allowed.end());
+        EXPECT_EQ(std::count(cores.begin(), cores.end(), cpu), 1);
+    }
+}
+
+// Every task runs exactly once whichever worker ends up with it
+TEST(UnitTests, WorkStealingRunsEveryTaskOnce) {
+    const std::vector<int> allowed = detail::allowed_cpus();
+    const int cpu = allowed.empty() ? 0 : allowed.front();
+    std::vector<std::atomic<int>> runs(37);
+    std::atomic<int> done{0};
+    detail::run_work_stealing(runs.size(), std::vector<int>{cpu, cpu, cpu}, [&](size_t task, int) {
+        // Uneven task lengths make the idle workers steal
+        if (task % 5 == 0) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+        }
+        runs[task].fetch_add(1);
+    }, [&](size_t) { done.fetch_add(1); });
+    EXPECT_EQ(done.load(), 37);
+    for (const auto& count : runs) {
+        EXPECT_EQ(count.load(), 1);
+    }
+}
+
+TEST(UnitTests, ParallelRunnerKeepsRegistrationOrder) {
+    const char* args[] = {"bench", "--jobs=4", "--check-interference"};
+    RunnerOptions options;
+    std::ostringstream err;
+    ASSERT_TRUE(parse_runner_options(3, const_cast<char**>(args), options, err));
+    EXPECT_EQ(options.jobs, 4u);
+    EXPECT_TRUE(options.check_interference);
+    const char* bad[] = {"bench", "--jobs=0"};
+    RunnerOptions rejected;
+    EXPECT_FALSE(parse_runner_options(2, const_cast<char**>(bad), rejected, err));
+
+    EXPECT_TRUE(Benchmark().co_runnable());
+    EXPECT_FALSE(Benchmark().threads(2).co_runnable());
+    EXPECT_FALSE(Benchmark().cache_mode(CacheMode::Cold).co_runnable());
+
+    options.filter = "registry_probe_beta";
+    options.repetitions = 3;
+    std::ostringstream out;
+    const auto results = run_registered(options, out);
+    ASSERT_EQ(results.size(), 3u);
+    for (size_t i = 0; i < results.size(); ++i) {
+        EXPECT_EQ(results[i].name, "registry_probe_beta");
+        EXPECT_EQ(results[i].repetition, i);
+    }
+}
+
+// Callback-style operations completed by an event loop driven from poll():
+// never more than queue_depth() of them are in flight
+TEST(UnitTests, RunAsyncRespectsQueueDepth) {
+    std::vector<Completion> pending;
+    size_t max_in_flight = 0;
+    auto submit = [&](Completion done) {
+        pending.push_back(done);
+        max_in_flight = std::max(max_in_flight, pending.size());
+    };
+    auto poll = [&] {
+        for (const Completion& done : pending) {
+            done();
+        }
+        pending.clear();
+    };
+    auto r = Benchmark().warmup(10).iterations(100).target_duration(std::chrono::milliseconds(5)).queue_depth(4)
+                 .run_async(submit, poll);
+    EXPECT_EQ(max_in_flight, 4u);
+    EXPECT_EQ(r.queue_depth, 4u);
+    EXPECT_EQ(r.durations.size(), r.iterations);
+    EXPECT_GT(r.aggregate_ops_per_sec, 0.0);
+    EXPECT_GT(r.mean_time, 0.0);
+
+    auto sweep = Benchmark().name("loop").warmup(10).target_duration(std::chrono::milliseconds(2))
+                     .run_queue_depths(submit, 6, poll);
+    ASSERT_EQ(sweep.size(), 4u);
+    EXPECT_EQ(sweep[3].name, "loop/depth:6");
+    EXPECT_EQ(sweep[3].queue_depth, 6u);
+}
+
+TEST(UnitTests, RunAsyncFuturesAndFailures) {
+    auto r = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).queue_depth(2).run_async([] {
+        std::promise<int> p;
+        p.set_value(1);
+        return p.get_future();
+    });
+    EXPECT_GT(r.sample_count, 0u);
+
+    // Deferred futures run when the driver collects them
+    Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).run_async([] {
+        return std::async(std::launch::deferred, [] { return 2; });
+    });
+
+    EXPECT_THROW(Benchmark().warmup(10).run_async([](Completion done) {
+        done.fail(std::make_exception_ptr(std::runtime_error("io error")));
+    }), std::runtime_error);
+}
+
+TEST(UnitTests, OpenLoopKeepsToTheOfferedRate) {
+    auto r = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(20))
+                 .offered_load(20000.0).run_open_loop([] { int x = 2; DoNotOptimize(x); });
+    EXPECT_EQ(r.iterations, 400u);
+    EXPECT_TRUE(r.streaming);
+    EXPECT_EQ(r.arrivals, Arrivals::Constant);
+    EXPECT_DOUBLE_EQ(r.offered_ops_per_sec, 20000.0);
+    EXPECT_GT(r.aggregate_ops_per_sec, 0.5 * 20000.0);
+
+    auto poisson = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(20))
+                       .offered_load(20000.0, Arrivals::Poisson).run_open_loop([] {});
+    EXPECT_EQ(poisson.arrivals, Arrivals::Poisson);
+    EXPECT_EQ(poisson.iterations, 400u);
+}
+
+TEST(UnitTests, OpenLoopCountsQueueingAfterAStall) {
+    // Every 50th call stalls for 2ms; the calls scheduled behind it wait,
+    // so the corrected tail is far above the mean service time.
+    int calls = 0;
+    auto r = Benchmark().warmup(1).unit(TimeUnit::Microseconds)
+                 .target_duration(std::chrono::milliseconds(20)).offered_load(10000.0)
+                 .run_open_loop([&] {
+                     if (++calls % 50 == 0) {
+                         const auto until = std::chrono::steady_clock::now() + std::chrono::milliseconds(2);
+                         while (std::chrono::steady_clock::now() < until) {}
+                     }
+                 });
+    EXPECT_GT(r.service_mean_time, 0.0);
+    EXPECT_GT(r.percentile(99.0), 5.0 * r.service_mean_time);
+    EXPECT_GT(r.percentile(99.0), 1000.0);
+}
+
+TEST(UnitTests, LoadSweepFindsSaturation) {
+    auto busy = [] {
+        const auto until = std::chrono::steady_clock::now() + std::chrono::microseconds(2);
+        while (std::chrono::steady_clock::now() < until) {}
+    };
+    auto sweep = Benchmark().name("busy").warmup(10).target_duration(std::chrono::milliseconds(5))
+                     .max_time(std::chrono::milliseconds(200)).run_load_sweep(busy, {1e7, 2000.0});
+    ASSERT_EQ(sweep.points.size(), 2u);
+    EXPECT_DOUBLE_EQ(sweep.points[0].offered_ops_per_sec, 2000.0);
+    EXPECT_EQ(sweep.points[1].name, "busy/rate:10000000");
+    EXPECT_TRUE(LoadSweep::sustained(sweep.points[0]));
+    EXPECT_FALSE(LoadSweep::sustained(sweep.points[1]));
+    EXPECT_DOUBLE_EQ(sweep.saturation_ops_per_sec, 2000.0);
+}
+
+namespace {
+const BenchmarkResult* find_result(const std::vector<BenchmarkResult>& results, const std::string& name) {
+    for (const auto& r : results) {
+        if (r.name == name) {
+            return &r;
+        }
+    }
+    return nullptr;
+}
+} // namespace
+
+TEST(UnitTests, ScopeProbesRecordFromAllThreads) {
+    auto& probes = ProbeRegistry::instance();
+    probes.reset();
+    auto work = [] {
+        PERFLITE_SCOPE("unit.probe");
+        int x = 1;
+        DoNotOptimize(x);
+    };
+    for (int i = 0; i < 1000; ++i) {
+        work();
+    }
+    // Threads that exit before the flush still have their events counted
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 3; ++t) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 500; ++i) {
+                work();
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    const auto results = probes.results(TimeUnit::Nanoseconds);
+    const BenchmarkResult* r = find_result(results, "unit.probe");
+    ASSERT_NE(r, nullptr);
+    EXPECT_EQ(r->sample_count, 2500u);
+    EXPECT_TRUE(r->streaming);
+    EXPECT_GT(r->max_time, 0.0);
+    EXPECT_LE(r->median_time, r->max_time);
+    EXPECT_EQ(probes.dropped(), 0u);
+
+    probes.reset();
+    EXPECT_EQ(find_result(probes.results(), "unit.probe"), nullptr);
+}
+
+TEST(UnitTests, ProbeRingDropsWhenFull) {
+    detail::ProbeRing ring;
+    for (size_t i = 0; i < detail::ProbeRing::kCapacity + 10; ++i) {
+        ring.push(3, 100 + i, i);
+    }
+    EXPECT_EQ(ring.dropped(), 10u);
+    ring.reset_dropped();
+    EXPECT_EQ(ring.dropped(), 0u);
+    ring.push(3, 0, 0);
+    EXPECT_EQ(ring.dropped(), 1u);
+    ring.reset_dropped();
+    size_t drained = 0;
+    ring.drain([&](uint32_t site, uint64_t start, uint64_t ticks) {
+        EXPECT_EQ(site, 3u);
+        EXPECT_EQ(start, 100 + drained);
+        EXPECT_EQ(ticks, drained);
+        ++drained;
+    });
+    EXPECT_EQ(drained, detail::ProbeRing::kCapacity);
+    ring.push(1, 0, uint64_t(1) << 60);  // Durations saturate instead of corrupting the site
+    ring.drain([](uint32_t site, uint64_t, uint64_t ticks) {
+        EXPECT_EQ(site, 1u);
+        EXPECT_EQ(ticks, detail::ProbeRing::kTickMask);
+    });
+}
+
+TEST(UnitTests, ProbeAggregatorDrainsInBackground) {
+    auto& probes = ProbeRegistry::instance();
+    // Overflow this thread's ring first: reset() must forget those drops too
+    probes.reset();
+    for (size_t i = 0; i < detail::ProbeRing::kCapacity + 10; ++i) {
+        PERFLITE_SCOPE("unit.aggregated");
+    }
+    EXPECT_GE(probes.dropped(), 10u);
+    probes.reset();
+    EXPECT_EQ(probes.dropped(), 0u);
+    probes.start_aggregator(std::chrono::milliseconds(1));
+    // More events than one ring holds, spread out so the aggregator keeps up
+    for (size_t round = 0; round < 4; ++round) {
+        for (size_t i = 0; i < detail::ProbeRing::kCapacity / 2; ++i) {
+            PERFLITE_SCOPE("unit.aggregated");
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    probes.stop_aggregator();
+    const BenchmarkResult* r = find_result(probes.results(), "unit.aggregated");
+    ASSERT_NE(r, nullptr);
+    EXPECT_EQ(r->sample_count + probes.dropped(), 2 * detail::ProbeRing::kCapacity);
+    EXPECT_GT(r->sample_count, detail::ProbeRing::kCapacity);
+}
+
+TEST(UnitTests, RecordTimestampsKeepsSampleStarts) {
+    auto r = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2))
+                 .record_timestamps().run([] { int x = 1; DoNotOptimize(x); });
+    ASSERT_EQ(r.sample_starts_ns.size(), r.durations.size());
+    EXPECT_TRUE(std::is_sorted(r.sample_starts_ns.begin(), r.sample_starts_ns.end()));
+    EXPECT_LE(r.sample_starts_ns.back(), detail::steady_now_ns());
+
+    // The adaptive loop grows the timestamps with the samples
+    auto adaptive = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).confidence_target(0.5)
+                        .record_timestamps().run([] {});
+    EXPECT_EQ(adaptive.sample_starts_ns.size(), adaptive.durations.size());
+
+    auto plain = Benchmark().warmup(10).target_duration(std::chrono::milliseconds(2)).run([] {});
+    EXPECT_TRUE(plain.sample_starts_ns.empty());
+}
+
+TEST(UnitTests, TraceWriterStreamsSamplesAndProbes) {
+    auto r = Benchmark().name("traced \"loop\"").warmup(10).target_duration(std::chrono::milliseconds(1))
+                 .batch_size(100).record_timestamps().run([] { int x = 1; DoNotOptimize(x); });
+
+    std::ostringstream os;
+    auto& probes = ProbeRegistry::instance();
+    {
+        TraceWriter trace(os, 256);  // Small chunks: written while events arrive
+        EXPECT_TRUE(trace.add_samples(r));
+        EXPECT_GT(os.str().size(), 0u);
+        probes.trace_to(&trace);
+        std::thread worker([] {
+            for (int i = 0; i < 10; ++i) {
+                PERFLITE_SCOPE("unit.traced");
+            }
+        });
+        worker.join();
+        probes.flush();
+        probes.trace_to(nullptr);
+        EXPECT_EQ(trace.events(), r.durations.size() + 10);
+        EXPECT_FALSE(trace.add_samples(Benchmark().target_duration(std::chrono::milliseconds(1)).run([] {})));
+
+        // Events after close() are dropped and the document stays complete
+        trace.close();
+        const size_t closed_size = os.str().size();
+        trace.complete("late", TraceWriter::kProbesPid, 1, 0.0, 1.0);
+        trace.name_track(TraceWriter::kProbesPid, 1, "late");
+        EXPECT_EQ(trace.events(), r.durations.size() + 10);
+        EXPECT_EQ(os.str().size(), closed_size);
+    }
+
+    detail::JsonValue doc;
+    ASSERT_TRUE(detail::JsonParser(os.str()).parse(doc));
+    const detail::JsonValue* events = doc.find("traceEvents");
+    ASSERT_NE(events, nullptr);
+    size_t samples = 0;
+    size_t traced = 0;
+    for (const auto& e : events->items) {
+        if (e.find("ph")->text != "X") {
+            continue;
+        }
+        EXPECT_GE(e.number_or("dur", -1.0), 0.0);
+        if (e.find("name")->text == "traced \"loop\"") {
+            EXPECT_EQ(e.number_or("pid", 0), TraceWriter::kSamplesPid);
+            // Each event spans the whole block of 100 calls (ts and dur in µs)
+            EXPECT_NEAR(e.number_or("dur", 0.0), r.durations[samples].count() * 100.0 / 1e3, 1e-3);
+            ++samples;
+        } else if (e.find("name")->text == "unit.traced") {
+            EXPECT_EQ(e.number_or("pid", 0), TraceWriter::kProbesPid);
+            ++traced;
+        }
+    }
+    EXPECT_EQ(samples, r.durations.size());
+    EXPECT_EQ(traced, 10u);
+}
+
+TEST(UnitTests, TypeNamesAreReadable) {
+    EXPECT_EQ(type_name<int>(), "int");
+    EXPECT_EQ(type_name<const double*>(), "const double*");
+    EXPECT_NE(type_name<std::vector<int>>().find("vector<int"), std::string::npos);
+}
+
+TEST(UnitTests, TypedAndFixtureRegistration) {
+    auto typed = Registry::instance().matching("^typed_probe_sum");
+    ASSERT_EQ(typed.size(), 2u);
+    EXPECT_EQ(typed[0]->name, "typed_probe_sum<int>");
+    EXPECT_EQ(typed[1]->name, "typed_probe_sum<double>");
+
+    // Configurations of a typed registration are adjusted together
+    auto set = Registry::instance().add_typed<TypeList<char, int>>(
+        "typed_probe_local", [](auto tag) { return typename decltype(tag)::type(3); });
+    EXPECT_EQ(set.size(), 2u);
+    set.each([](Benchmark& b) { b.target_duration(std::chrono::milliseconds(1)).warmup(1); });
+
+    RunnerOptions options;
+    options.filter = "^typed_probe_local<int>$";
+    std::ostringstream out;
+    auto results = run_registered(options, out);
+    ASSERT_EQ(results.size(), 1u);
+    EXPECT_EQ(results[0].name, "typed_probe_local<int>");
+    EXPECT_EQ(results[0].warmup_iterations, 1u);
+
+    // The fixture is built once and reused across repetitions
+    options.filter = "^FixtureProbe/sum$";
+    options.repetitions = 3;
+    results = run_registered(options, out);
+    ASSERT_EQ(results.size(), 3u);
+    EXPECT_EQ(fixture_probe_constructions, 1);
+
+    options.filter = "^TypedFixtureProbe/product";
+    options.repetitions = 1;
+    results = run_registered(options, out);
+    ASSERT_EQ(results.size(), 2u);
+    EXPECT_EQ(results[0].name, "TypedFixtureProbe/product<int>");
+    EXPECT_EQ(results[1].name, "TypedFixtureProbe/product<float>");
+}
+
+TEST(UnitTests, TrackMemoryReportsFaultsAndRssGrowth) {
+#if defined(PERFLITE_HAS_MMAP)
+    // Every call touches the next page of a fresh mapping, so each call
+    // takes one minor fault and RSS grows by a page per call.
+    constexpr size_t kPage = 4096;
+    constexpr size_t kPages = 1 << 15;
+    char* region = static_cast<char*>(mmap(nullptr, kPages * kPage, PROT_READ | PROT_WRITE,
+                                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    ASSERT_NE(region, MAP_FAILED);
+#if defined(MADV_NOHUGEPAGE)
+    madvise(region, kPages * kPage, MADV_NOHUGEPAGE);
+#endif
+    size_t touched = 0;
+    auto grow = Benchmark().warmup(1).target_duration(std::chrono::milliseconds(1)).track_memory()
+                    .run([&] {
+                        if (touched < kPages) {
+                            region[touched++ * kPage] = 1;
+                        }
+                    });
+    ASSERT_LT(touched, kPages);
+    ASSERT_TRUE(grow.memory_tracked);
+    EXPECT_GT(grow.minor_faults_per_iteration, 0.5);
+    EXPECT_GT(grow.rss_growth_bytes, static_cast<int64_t>(grow.iterations * kPage / 2));
+    EXPECT_GE(grow.peak_rss_growth_bytes, static_cast<uint64_t>(grow.rss_growth_bytes));
+    munmap(region, kPages * kPage);
+#else
+    auto grow = Benchmark().warmup(1).target_duration(std::chrono::milliseconds(1)).track_memory().run([] {});
+#endif
+
+    auto idle = Benchmark().warmup(1).target_duration(std::chrono::milliseconds(1)).track_memory().run([] {});
+    ASSERT_TRUE(idle.memory_tracked);
+    EXPECT_LT(idle.minor_faults_per_iteration, 0.01);
+    EXPECT_FALSE(Benchmark().track_memory().co_runnable());
+
+    std::ostringstream json;
+    write_json(json, {grow});
+    EXPECT_NE(json.str().find("\"minor_faults_per_iteration\""), std::string::npos);
+    std::ostringstream csv;
+    grow.environment.cpu_model.clear();  // Keep quoted commas out of the field count
+    idle.environment.cpu_model.clear();
+    write_csv(csv, {grow, idle});
+    const std::string text = csv.str();
+    EXPECT_NE(text.find("peak_rss_growth_bytes"), std::string::npos);
+    // Every row has as many fields as the header
+    std::istringstream rows(text);
+    std::string header;
+    std::getline(rows, header);
+    for (std::string row; std::getline(rows, row);) {
+        EXPECT_EQ(std::count(row.begin(), row.end(), ','), std::count(header.begin(), header.end(), ','));
+    }
+    std::ostringstream printed;
+    grow.print(printed);
+    EXPECT_NE(printed.str().find("RSS growth"), std::string::npos);
+}
+
+TEST(UnitTests, PerfliteMainReportsBenchmarkFailures) {
+    // The allocation check throws inside the runner; main reports it and fails
+    const char* argv[] = {"bench", "--filter=^allocation_check_probe$", "--format=json"};
+    testing::internal::CaptureStderr();
+    const int code = perflite_main(3, const_cast<char**>(argv));
+    const std::string err = testing::internal::GetCapturedStderr();
+    EXPECT_EQ(code, 1);
+    EXPECT_NE(err.find("Error: allocation_check_probe: "), std::string::npos);
+    EXPECT_NE(err.find("expected no allocations"), std::string::npos);
+
+    RunnerOptions options;
+    options.filter = "^allocation_check_probe$";
+    std::ostringstream out;
+    try {
+        run_registered(options, out);
+        FAIL() << "expected BenchmarkError";
+    } catch (const BenchmarkError& e) {
+        EXPECT_EQ(e.benchmark(), "allocation_check_probe");
+        EXPECT_THROW(std::rethrow_exception(e.cause()), std::runtime_error);
+    }
+}
+
+TEST(UnitTests, SubtractOverheadWarnsForStateBenchmarks) {
+    testing::internal::CaptureStderr();
+    auto r = Benchmark().name("state_overhead").warmup(1).target_duration(std::chrono::milliseconds(1))
+                 .subtract_overhead().run([](State& state) {
+                     for (auto _ : state) {
+                         int x = 1;
+                         DoNotOptimize(x);
+                     }
+                 });
+    const std::string err = testing::internal::GetCapturedStderr();
+    EXPECT_NE(err.find("'state_overhead' reports uncorrected times"), std::string::npos);
+    EXPECT_FALSE(r.subtract_overhead);
+    EXPECT_DOUBLE_EQ(r.overhead_ns, 0.0);
+}